@@ -0,0 +1,33 @@
+#ifndef CANNED_RESPONSE_HPP
+#define CANNED_RESPONSE_HPP
+
+#include <boost/utility/string_ref.hpp>
+
+namespace x {
+namespace codec {
+namespace http {
+
+/*
+ * The responses made by the proxy itself, rather than forwarded from the
+ * server. The error responses close the connection.
+ */
+enum canned_response_type {
+    CONNECTION_ESTABLISHED, // 200, the reply of CONNECT
+    BAD_REQUEST,            // 400, the request can not be decoded
+    BAD_GATEWAY,            // 502, the server failed before it responded
+    SERVICE_UNAVAILABLE,    // 503, HTTPS is not available, with Retry-After
+    GATEWAY_TIMEOUT,        // 504, the server did not respond in time, with Retry-After
+    CANNED_RESPONSE_COUNT
+};
+
+/*
+ * Returns the encoded bytes of the response, which are static, so nothing is
+ * encoded or allocated for them.
+ */
+boost::string_ref canned_response(canned_response_type type);
+
+} // namespace http
+} // namespace codec
+} // namespace x
+
+#endif // CANNED_RESPONSE_HPP
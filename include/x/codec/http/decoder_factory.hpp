@@ -0,0 +1,50 @@
+#ifndef DECODER_FACTORY_HPP
+#define DECODER_FACTORY_HPP
+
+#include <string>
+#include "http_parser.h"
+#include "x/codec/message_decoder.hpp"
+
+namespace x {
+namespace codec {
+namespace http {
+
+/*
+ * The HTTP/1.x decoder backends, http_decoder is based on http-parser, and
+ * simd_http_decoder finds the delimiters with SIMD instructions.
+ */
+enum decoder_backend {
+    HTTP_PARSER_BACKEND,
+    SIMD_BACKEND
+};
+
+/*
+ * Selects the backend by name, "http-parser" or "simd", it should be called
+ * before any connection is created.
+ */
+bool set_decoder_backend(const std::string& name);
+
+decoder_backend get_decoder_backend();
+
+message_decoder *make_decoder(http_parser_type type);
+
+enum { DEFAULT_BODY_RESERVE_LIMIT = 64 * 1024 };
+
+/*
+ * A body whose Content-Length is not larger than the limit is reserved in one
+ * allocation when the headers are decoded, a larger body is not reserved.
+ *
+ * A larger response body is forwarded piece by piece, but a request is only
+ * delivered when it is complete, so a larger request body is still buffered
+ * as a whole and grows by doubling, which takes O(log n) reallocations and
+ * up to twice the body size at the peak.
+ */
+void set_body_reserve_limit(std::size_t limit);
+
+std::size_t get_body_reserve_limit();
+
+} // namespace http
+} // namespace codec
+} // namespace x
+
+#endif // DECODER_FACTORY_HPP
@@ -21,12 +21,25 @@ public:
 
     bool message_completed() const { return message_completed_; }
 
-    bool keep_alive() const;
+    virtual bool keep_alive() const;
+
+    virtual std::size_t body_remaining() const;
+
+    virtual void skip_body(std::size_t length);
+
+    /*
+     * Converts the request target to the origin form, which is sent to the
+     * server, i.e. "http://example.com/some/resource" to "/some/resource".
+     */
+    static std::string origin_form(const char *uri, std::size_t length);
 
 public:
     http_decoder(http_parser_type type)
         : message_(nullptr), headers_completed_(false),
-          message_completed_(false), chunked_(false) {
+          message_completed_(false), chunked_(false),
+          in_headers_(false), raw_begin_(nullptr),
+          field_offset_(0), field_end_(0), value_offset_(0), value_end_(0),
+          value_seen_(false), body_begin_(nullptr) {
         ::http_parser_init(&parser_, type);
         parser_.data = this;
     }
@@ -43,6 +56,10 @@ public:
     static int on_message_complete(http_parser *parser);
 
 private:
+    std::size_t execute(const char *begin, std::size_t length);
+    std::size_t collect(const char *at, std::size_t length);
+    void add_header();
+
     const char *error_message() const {
         return ::http_errno_description(static_cast<http_errno>(parser_.http_errno));
     }
@@ -53,8 +70,23 @@ private:
     bool headers_completed_;
     bool message_completed_;
     bool chunked_;
-    std::string current_header_field_;
-    std::string current_header_value_;
+    // the raw header lines are collected into the headers of the message,
+    // from the first header field to the end of the headers, raw_begin_
+    // points to the first byte not collected yet in the data being decoded
+    bool in_headers_;
+    const char *raw_begin_;
+
+    // offsets of the current header field and value in the raw headers
+    std::size_t field_offset_;
+    std::size_t field_end_;
+    std::size_t value_offset_;
+    std::size_t value_end_;
+    bool value_seen_;
+
+    // a chunked body is forwarded as it is received, with the chunk framing
+    // and the trailers, http-parser only finds where it ends, body_begin_
+    // points to the first byte of the body not appended yet
+    const char *body_begin_;
 
     http_parser parser_;
 
@@ -27,6 +27,10 @@ private:
     std::size_t encode_headers(const message::http::http_message& msg, memory::byte_buffer& buf);
     std::size_t encode_body(const message::http::http_message& msg, memory::byte_buffer& buf);
 
+    std::size_t first_line_size(const message::http::http_message& msg) const;
+    std::size_t headers_size(const message::http::http_message& msg) const;
+    std::size_t body_size(const message::http::http_message& msg) const;
+
     enum encode_state {
         BEGIN, FIRST_LINE, HEADERS, BODY, END
     };
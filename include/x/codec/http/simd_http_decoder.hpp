@@ -0,0 +1,114 @@
+#ifndef SIMD_HTTP_DECODER_HPP
+#define SIMD_HTTP_DECODER_HPP
+
+#include <string>
+#include "http_parser.h"
+#include "x/common.hpp"
+#include "x/codec/message_decoder.hpp"
+
+namespace x {
+namespace message { namespace http { class http_message; } }
+namespace codec {
+namespace http {
+
+/*
+ * An HTTP/1.x decoder which finds the delimiters with SIMD instructions.
+ *
+ * Unlike http_decoder, which runs http-parser byte by byte, the message head
+ * is only parsed when it is complete: the end of the head is located first,
+ * then the lines and the header separators are found with SSE4.2 or AVX2 if
+ * they are enabled at compile time, or with a scalar loop otherwise. The head
+ * is copied only when it spans reads.
+ *
+ * The messages decoded are the same as those decoded by http_decoder.
+ */
+class simd_http_decoder : public message_decoder {
+public:
+    virtual std::size_t decode(const char *begin, std::size_t length, message::message& msg);
+
+    virtual void reset();
+
+    virtual bool keep_alive() const;
+
+    virtual std::size_t body_remaining() const;
+
+    virtual void skip_body(std::size_t length);
+
+    bool headers_completed() const { return headers_completed_; }
+
+    bool message_completed() const { return message_completed_; }
+
+public:
+    simd_http_decoder(http_parser_type type)
+        : type_(type) {
+        reset();
+    }
+
+    DEFAULT_VIRTUAL_DTOR(simd_http_decoder);
+
+    /*
+     * Returns the name of the instruction set used to find the delimiters.
+     */
+    static const char *instruction_set();
+
+private:
+    enum decode_state {
+        HEAD,
+        BODY_IDENTITY,  // the body length is given by Content-Length
+        BODY_EOF,       // the body ends when the connection is closed
+        CHUNK_SIZE,
+        CHUNK_EXTENSION,
+        CHUNK_DATA,
+        CHUNK_DATA_END,
+        CHUNK_TRAILER,
+        DONE,
+        INVALID
+    };
+
+    enum {
+        MAX_HEAD_SIZE = 80 * 1024
+    };
+
+    std::size_t decode_head(const char *begin, const char *end);
+    std::size_t decode_body(const char *begin, const char *end);
+
+    bool parse_head(const char *head, std::size_t size);
+    bool parse_request_line(const char *begin, const char *end);
+    bool parse_status_line(const char *begin, const char *end);
+    bool parse_version(const char *begin, const char *end);
+    bool parse_headers(const char *begin, const char *end);
+    bool parse_connection(const std::string& value);
+    bool prepare_body();
+
+    void complete();
+    std::size_t fail(const char *reason);
+
+    http_parser_type type_;
+    message::http::http_message *message_;
+
+    decode_state state_;
+    bool headers_completed_;
+    bool message_completed_;
+
+    // the head received so far, only used when the head spans reads
+    std::string head_;
+
+    int major_version_;
+    int minor_version_;
+    int status_;
+    bool chunked_;
+    bool content_length_set_;
+    bool connection_close_;
+    bool connection_keep_alive_;
+    std::size_t remaining_;         // bytes remaining of the body or the chunk
+    bool chunk_size_seen_;
+    bool trailer_line_empty_;
+
+    MAKE_NONCOPYABLE(simd_http_decoder);
+};
+
+} // namespace http
+} // namespace codec
+} // namespace x
+
+#endif // SIMD_HTTP_DECODER_HPP
@@ -12,9 +12,33 @@ class message_decoder {
 public:
     DEFAULT_DTOR(message_decoder);
 
+    /*
+     * Decodes the data into the message, and returns the bytes consumed, or 0
+     * on error. The decoding stops at the end of the message, the data left
+     * belongs to the next message, e.g. a pipelined request.
+     */
     virtual std::size_t decode(const char *begin, std::size_t length, message::message& msg) = 0;
 
     virtual void reset() = 0;
+
+    /*
+     * Returns true if the connection can be kept alive after the message
+     * being decoded.
+     */
+    virtual bool keep_alive() const = 0;
+
+    /*
+     * Returns the length of the body still to be received if it is known,
+     * i.e. given by Content-Length, otherwise returns 0.
+     *
+     * The bytes of such a body need not be decoded, the connection can pass
+     * them through, and tell the decoder by skip_body(), which completes the
+     * message when the whole body is skipped. The decoder must then be reset
+     * before the next message.
+     */
+    virtual std::size_t body_remaining() const = 0;
+
+    virtual void skip_body(std::size_t length) = 0;
 };
 
 } // namespace codec
@@ -0,0 +1,113 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <vector>
+#include "x/common.hpp"
+
+namespace x {
+namespace memory {
+
+/*
+ * A per-thread pool of memory blocks.
+ *
+ * Blocks are grouped into size classes, the size of class i is
+ * (MIN_BLOCK_SIZE << i). A request is served by the smallest class which is
+ * large enough, blocks larger than the largest class are not pooled at all.
+ * Released blocks are kept for reuse until the retained memory reaches the
+ * limit, the blocks beyond that are freed.
+ *
+ * The pool is not thread safe, each thread has its own one. Blocks are plain
+ * heap memory, a block released in another thread goes to the pool of that
+ * thread.
+ */
+class buffer_pool {
+public:
+    enum {
+        MIN_BLOCK_SIZE = 1024,
+        CLASS_COUNT = 9, // the largest class is 256 KB
+        MAX_BLOCK_SIZE = MIN_BLOCK_SIZE << (CLASS_COUNT - 1),
+        DEFAULT_MAX_RETAINED = 4 * 1024 * 1024
+    };
+
+    static buffer_pool& local() {
+        static thread_local buffer_pool pool;
+        return pool;
+    }
+
+    buffer_pool() : retained_(0), max_retained_(DEFAULT_MAX_RETAINED) {}
+
+    virtual ~buffer_pool() {
+        for (std::size_t i = 0; i < CLASS_COUNT; ++i) {
+            for (auto it = free_[i].begin(); it != free_[i].end(); ++it)
+                delete [] *it;
+        }
+    }
+
+    /*
+     * Returns a block of at least size bytes, the actual size of the block
+     * is returned in capacity, which must be passed back to release().
+     */
+    char *acquire(std::size_t size, std::size_t& capacity) {
+        auto index = size_class(size);
+        if (index >= CLASS_COUNT) {
+            capacity = size;
+            return new char[capacity];
+        }
+
+        capacity = class_size(index);
+        if (free_[index].empty())
+            return new char[capacity];
+
+        char *block = free_[index].back();
+        free_[index].pop_back();
+        retained_ -= capacity;
+        return block;
+    }
+
+    void release(char *block, std::size_t capacity) {
+        if (!block)
+            return;
+
+        auto index = size_class(capacity);
+        if (index >= CLASS_COUNT || class_size(index) != capacity ||
+            retained_ + capacity > max_retained_) {
+            delete [] block;
+            return;
+        }
+
+        free_[index].push_back(block);
+        retained_ += capacity;
+    }
+
+    std::size_t retained() const {
+        return retained_;
+    }
+
+    void set_max_retained(std::size_t max_retained) {
+        max_retained_ = max_retained;
+    }
+
+    static std::size_t size_class(std::size_t size) {
+        std::size_t index = 0;
+        while (index < CLASS_COUNT && class_size(index) < size)
+            ++index;
+        return index;
+    }
+
+    static std::size_t class_size(std::size_t index) {
+        return static_cast<std::size_t>(MIN_BLOCK_SIZE) << index;
+    }
+
+private:
+    std::vector<char *> free_[CLASS_COUNT];
+    std::size_t retained_;
+    std::size_t max_retained_;
+
+    MAKE_NONCOPYABLE(buffer_pool);
+};
+
+} // namespace memory
+} // namespace x
+
+#endif // BUFFER_POOL_HPP
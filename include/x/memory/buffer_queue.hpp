@@ -0,0 +1,111 @@
+#ifndef BUFFER_QUEUE_HPP
+#define BUFFER_QUEUE_HPP
+
+#include "x/common.hpp"
+#include "x/memory/byte_buffer.hpp"
+
+namespace x {
+namespace memory {
+
+/*
+ * An intrusive singly linked queue of buffers, used as the write queue.
+ *
+ * The queue links the buffers through the hook inside byte_buffer, so no node
+ * is allocated, a buffer can therefore be in at most one queue at a time. The
+ * bytes consumed from the front buffer are tracked with an offset instead of
+ * being erased, and the total number of pending bytes is kept, which is used
+ * to decide whether the peer should stop reading.
+ */
+class buffer_queue {
+public:
+    buffer_queue() : head_(nullptr), tail_(nullptr), bytes_(0), offset_(0) {}
+
+    virtual ~buffer_queue() {
+        while (!empty())
+            pop_front();
+    }
+
+    bool empty() const {
+        return head_ == nullptr;
+    }
+
+    /*
+     * Returns the number of bytes not consumed yet.
+     */
+    std::size_t bytes() const {
+        return bytes_;
+    }
+
+    void push_back(buffer_ptr buf) {
+        assert(buf && !buf->next_ && buf.get() != tail_);
+
+        byte_buffer *p = buf.get();
+        intrusive_ptr_add_ref(p);
+
+        if (tail_)
+            tail_->next_ = p;
+        else
+            head_ = p;
+        tail_ = p;
+
+        bytes_ += p->size();
+    }
+
+    buffer_ptr pop_front() {
+        assert(head_);
+
+        // the reference held by the queue is taken over
+        buffer_ptr buf(head_, false);
+
+        head_ = head_->next_;
+        if (!head_)
+            tail_ = nullptr;
+        buf->next_ = nullptr;
+
+        bytes_ -= buf->size() - offset_;
+        offset_ = 0;
+
+        return buf;
+    }
+
+    const char *front_data() const {
+        assert(head_);
+        return head_->data() + offset_;
+    }
+
+    std::size_t front_size() const {
+        assert(head_);
+        return head_->size() - offset_;
+    }
+
+    /*
+     * Marks length bytes of the front buffer as consumed, returns true if the
+     * whole front buffer is consumed, then it should be popped.
+     */
+    bool consume(std::size_t length) {
+        assert(head_ && length <= front_size());
+
+        offset_ += length;
+        bytes_ -= length;
+        return offset_ == head_->size();
+    }
+
+    template<typename Function>
+    void for_each(Function f) const {
+        for (auto p = head_; p; p = p->next_)
+            f(*p);
+    }
+
+private:
+    byte_buffer *head_;
+    byte_buffer *tail_;
+    std::size_t bytes_;
+    std::size_t offset_;
+
+    MAKE_NONCOPYABLE(buffer_queue);
+};
+
+} // namespace memory
+} // namespace x
+
+#endif // BUFFER_QUEUE_HPP
@@ -4,6 +4,10 @@
 #include <cstring>
 #include <cassert>
 #include <memory>
+#include <vector>
+#include <boost/intrusive_ptr.hpp>
+#include "x/memory/buffer_pool.hpp"
+#include "x/util/itoa.hpp"
 
 namespace x {
 namespace memory {
@@ -34,12 +38,12 @@ public:
     }
 
     virtual ~byte_buffer() {
-        if(data_) delete [] data_;
+        buffer_pool::local().release(data_, capacity_);
     }
 
     explicit byte_buffer(size_type size = 0)
-        : data_(new char[size ? size : DEFAULT_SIZE]), size_(0),
-          capacity_(size ? size : DEFAULT_SIZE) {}
+        : data_(buffer_pool::local().acquire(size ? size : DEFAULT_SIZE, capacity_)),
+          size_(0), refs_(0), next_(nullptr) {}
 
     byte_buffer(const void *data, size_type size) : byte_buffer(size) {
         assert(data);
@@ -47,10 +51,20 @@ public:
         size_ = size;
     }
 
+    /*
+     * Takes over a block of the buffer pool, of which the first size bytes
+     * are the data.
+     */
+    byte_buffer(char *block, size_type capacity, size_type size)
+        : data_(block), size_(size), capacity_(capacity), refs_(0), next_(nullptr) {
+        assert(block && size <= capacity);
+    }
+
     byte_buffer(const byte_buffer& buffer) : byte_buffer(buffer.data_, buffer.size_) {}
 
     byte_buffer(byte_buffer&& buffer)
-        : data_(buffer.data_), size_(buffer.size_), capacity_(buffer.capacity_) {
+        : data_(buffer.data_), size_(buffer.size_), capacity_(buffer.capacity_),
+          refs_(0), next_(nullptr) {
         buffer.data_ = nullptr;
         buffer.size_ = 0;
         buffer.capacity_ = 0;
@@ -58,9 +72,8 @@ public:
 
     byte_buffer& operator=(const byte_buffer& buffer) {
         if(this->capacity_ < buffer.size_) {
-            delete [] data_;
-            capacity_ = buffer.size_;
-            data_ = new char[capacity_];
+            buffer_pool::local().release(data_, capacity_);
+            data_ = buffer_pool::local().acquire(buffer.size_, capacity_);
         }
 
         std::memcpy(data_, buffer.data_, buffer.size_);
@@ -70,7 +83,7 @@ public:
     }
 
     byte_buffer& operator=(byte_buffer&& buffer) {
-        delete [] data_;
+        buffer_pool::local().release(data_, capacity_);
 
         data_ = buffer.data_;
         size_ = buffer.size_;
@@ -105,18 +118,24 @@ public:
 
     byte_buffer& operator<<(const std::string& str) {
         ensure_size(str.size());
-        for (auto it : str) {
-            data_[size_++] = it;
-        }
+        std::memcpy(data_ + size_, str.data(), str.size());
+        size_ += str.size();
         return *this;
     }
 
     byte_buffer& operator<<(const char *cstr) {
-        return operator<<(std::string(cstr));
+        return operator<<(wrap(cstr, std::strlen(cstr)));
     }
 
     byte_buffer& operator<<(int num) {
-        return operator<<(std::to_string(num));
+        ensure_size(21); // the sign and 20 digits at most
+        std::uint64_t value = num;
+        if (num < 0) {
+            data_[size_++] = '-';
+            value = -static_cast<std::int64_t>(num);
+        }
+        size_ += util::itoa(value, data_ + size_);
+        return *this;
     }
 
     byte_buffer& operator<<(const byte_buffer& buffer) {
@@ -150,9 +169,37 @@ public:
     size_type          size()     const { return size_; }
     bool               empty()    const { return size_ == 0; }
     size_type          capacity() const { return capacity_; }
+    std::size_t        use_count() const { return refs_; }
     #warning shrink job here?
     void               clear()          { size_ = 0; }
 
+    /*
+     * Appends size bytes which are not initialized, and returns the pointer
+     * to them, so that the data can be written in place.
+     */
+    pointer_type grow(size_type size) {
+        ensure_size(size);
+        auto p = data_ + size_;
+        size_ += size;
+        return p;
+    }
+
+    /*
+     * Makes the capacity at least capacity bytes in one allocation, the data
+     * is kept.
+     */
+    void reserve(size_type capacity) {
+        if (capacity <= capacity_)
+            return;
+
+        char *tmp = data_;
+        size_type old_capacity = capacity_;
+        data_ = buffer_pool::local().acquire(capacity, capacity_);
+        if (size_ > 0)
+            std::memcpy(data_, tmp, size_);
+        buffer_pool::local().release(tmp, old_capacity);
+    }
+
     pointer_type data(size_type pos) {
         return pos < size_ ? data_ + pos : nullptr;
     }
@@ -180,19 +227,83 @@ private:
             return;
 
         char *tmp = data_;
-        #warning the allocation algorithm here could be refined
-        capacity_ = capacity_ * GROW_FACTOR + size;
-        data_ = new char[capacity_];
+        size_type capacity = capacity_;
+        data_ = buffer_pool::local().acquire(capacity_ * GROW_FACTOR + size, capacity_);
         std::memcpy(data_, tmp, size_);
-        delete [] tmp;
+        buffer_pool::local().release(tmp, capacity);
+    }
+
+    friend class buffer_queue;
+
+    friend void intrusive_ptr_add_ref(byte_buffer *buffer) {
+        ++buffer->refs_;
+    }
+
+    friend void intrusive_ptr_release(byte_buffer *buffer) {
+        if (--buffer->refs_ == 0)
+            delete buffer;
     }
 
     char *data_;
     size_type size_;
     size_type capacity_;
+
+    // buffers are only shared inside one thread, so the reference count
+    // needs not to be atomic
+    std::size_t refs_;
+
+    // the hook of buffer_queue
+    byte_buffer *next_;
 };
 
-typedef std::shared_ptr<byte_buffer> buffer_ptr;
+typedef boost::intrusive_ptr<byte_buffer> buffer_ptr;
+
+/*
+ * A per-thread cache of byte_buffer objects.
+ *
+ * Buffers which are no longer referenced elsewhere are cleared and kept for
+ * the next encode, so that neither the buffer object nor its storage is
+ * allocated again. Large buffers are not cached, their storage goes back to
+ * the buffer pool, which limits the memory retained.
+ */
+class buffer_cache {
+public:
+    enum {
+        MAX_CACHED_BUFFERS = 64,
+        MAX_CACHED_CAPACITY = 64 * 1024
+    };
+
+    static buffer_cache& local() {
+        static thread_local buffer_cache cache;
+        return cache;
+    }
+
+    buffer_cache() = default;
+
+    buffer_ptr acquire() {
+        if (buffers_.empty())
+            return buffer_ptr(new byte_buffer);
+
+        buffer_ptr buf(std::move(buffers_.back()));
+        buffers_.pop_back();
+        return buf;
+    }
+
+    void recycle(buffer_ptr buf) {
+        if (!buf || buf->use_count() > 1 ||
+            buf->capacity() > MAX_CACHED_CAPACITY ||
+            buffers_.size() >= MAX_CACHED_BUFFERS)
+            return;
+
+        buf->clear();
+        buffers_.push_back(std::move(buf));
+    }
+
+private:
+    std::vector<buffer_ptr> buffers_;
+
+    MAKE_NONCOPYABLE(buffer_cache);
+};
 
 } // namespace memory
 } // namespace x
@@ -0,0 +1,115 @@
+#ifndef HTTP_HEADER_ID_HPP
+#define HTTP_HEADER_ID_HPP
+
+#include <cstdint>
+#include <boost/utility/string_ref.hpp>
+
+namespace x {
+namespace message {
+namespace http {
+
+/*
+ * IDs of the well-known headers, the headers not listed here are
+ * HEADER_UNKNOWN, and they are only looked up by name.
+ */
+enum header_id {
+    HEADER_UNKNOWN = 0,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_TYPE,
+    HEADER_EXPECT,
+    HEADER_HOST,
+    HEADER_KEEP_ALIVE,
+    HEADER_PROXY_AUTHORIZATION,
+    HEADER_PROXY_CONNECTION,
+    HEADER_TE,
+    HEADER_TRAILER,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_UPGRADE,
+    HEADER_COUNT
+};
+
+namespace detail {
+
+constexpr char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+constexpr std::uint32_t hash(const char *s, std::size_t n, std::uint32_t h) {
+    return n == 0 ? h : hash(s + 1, n - 1, (h ^ static_cast<unsigned char>(lower(*s))) * 16777619u);
+}
+
+} // namespace detail
+
+/*
+ * The case-insensitive FNV-1a hash of a header name, it must be the same as
+ * http_headers::hash(), which computes it at runtime.
+ */
+template<std::size_t N>
+constexpr std::uint32_t header_hash(const char (&name)[N]) {
+    return detail::hash(name, N - 1, 2166136261u);
+}
+
+inline const char *header_name(header_id id) {
+    static const char *names[HEADER_COUNT] = {
+        "",
+        "Connection",
+        "Content-Length",
+        "Content-Type",
+        "Expect",
+        "Host",
+        "Keep-Alive",
+        "Proxy-Authorization",
+        "Proxy-Connection",
+        "TE",
+        "Trailer",
+        "Transfer-Encoding",
+        "Upgrade"
+    };
+    return names[id];
+}
+
+/*
+ * Maps a header name to its ID, hash is the case-insensitive hash of the name.
+ *
+ * The case labels are the hashes of the well-known names computed at compile
+ * time, a collision among them would be a duplicate case label, so the switch
+ * is a perfect hash of the names, which is confirmed by a comparison as an
+ * unknown name may still have the same hash.
+ */
+inline header_id to_header_id(boost::string_ref name, std::uint32_t hash) {
+    header_id id = HEADER_UNKNOWN;
+    switch (hash) {
+    case header_hash("connection"):          id = HEADER_CONNECTION; break;
+    case header_hash("content-length"):      id = HEADER_CONTENT_LENGTH; break;
+    case header_hash("content-type"):        id = HEADER_CONTENT_TYPE; break;
+    case header_hash("expect"):              id = HEADER_EXPECT; break;
+    case header_hash("host"):                id = HEADER_HOST; break;
+    case header_hash("keep-alive"):          id = HEADER_KEEP_ALIVE; break;
+    case header_hash("proxy-authorization"): id = HEADER_PROXY_AUTHORIZATION; break;
+    case header_hash("proxy-connection"):    id = HEADER_PROXY_CONNECTION; break;
+    case header_hash("te"):                  id = HEADER_TE; break;
+    case header_hash("trailer"):             id = HEADER_TRAILER; break;
+    case header_hash("transfer-encoding"):   id = HEADER_TRANSFER_ENCODING; break;
+    case header_hash("upgrade"):             id = HEADER_UPGRADE; break;
+    default:
+        return HEADER_UNKNOWN;
+    }
+
+    boost::string_ref known(header_name(id));
+    if (known.size() != name.size())
+        return HEADER_UNKNOWN;
+
+    for (std::size_t i = 0; i < name.size(); ++i) {
+        if (detail::lower(known[i]) != detail::lower(name[i]))
+            return HEADER_UNKNOWN;
+    }
+
+    return id;
+}
+
+} // namespace http
+} // namespace message
+} // namespace x
+
+#endif // HTTP_HEADER_ID_HPP
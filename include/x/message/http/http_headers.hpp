@@ -0,0 +1,264 @@
+#ifndef HTTP_HEADERS_HPP
+#define HTTP_HEADERS_HPP
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include "x/common.hpp"
+#include "x/message/http/http_header_id.hpp"
+
+namespace x {
+namespace message {
+namespace http {
+
+/*
+ * A flat table of HTTP headers.
+ *
+ * The names and values are stored one after another in a single string, the
+ * headers themselves are kept in a vector of offsets, in the order they are
+ * added, repeated headers such as Set-Cookie are all kept. A small hash index
+ * chains the headers with the same case-insensitive name hash, so a lookup by
+ * name does not scan the whole table.
+ *
+ * The well-known headers are given their IDs when added, and the first header
+ * of each ID is indexed, so looking them up is only an array access.
+ *
+ * When decoded, the raw header block is copied into the storage as it is, and
+ * the headers are only offsets of the names and values in it, which are added
+ * by add_raw(). The raw block is kept valid until the headers are modified.
+ */
+class http_headers {
+public:
+    typedef boost::string_ref string_ref;
+
+    static const std::size_t npos = static_cast<std::size_t>(-1);
+
+    http_headers() : raw_size_(0), raw_valid_(false) {
+        buckets_.fill(0);
+        known_.fill(0);
+    }
+
+    DEFAULT_DTOR(http_headers);
+
+    std::size_t size() const {
+        return entries_.size();
+    }
+
+    bool empty() const {
+        return entries_.empty();
+    }
+
+    string_ref name(std::size_t i) const {
+        return string_ref(data_.data() + entries_[i].name_offset, entries_[i].name_size);
+    }
+
+    string_ref value(std::size_t i) const {
+        return string_ref(data_.data() + entries_[i].value_offset, entries_[i].value_size);
+    }
+
+    header_id id(std::size_t i) const {
+        return static_cast<header_id>(entries_[i].id);
+    }
+
+    void add(string_ref name, string_ref value) {
+        auto offset = data_.size();
+        data_.append(name.data(), name.size());
+        data_.append(value.data(), value.size());
+        raw_valid_ = false;
+
+        add_entry(offset, name.size(), offset + name.size(), value.size());
+    }
+
+    /*
+     * Appends the bytes of the raw header block, it must be done before any
+     * header is added by add().
+     */
+    void append_raw(const char *data, std::size_t size) {
+        assert(raw_size_ == data_.size());
+        data_.append(data, size);
+        raw_size_ += size;
+    }
+
+    std::size_t raw_size() const {
+        return raw_size_;
+    }
+
+    /*
+     * Adds a header whose name and value are already in the raw block.
+     */
+    void add_raw(std::size_t name_offset, std::size_t name_size,
+                 std::size_t value_offset, std::size_t value_size) {
+        assert(name_offset + name_size <= raw_size_);
+        assert(value_offset + value_size <= raw_size_);
+        add_entry(name_offset, name_size, value_offset, value_size);
+    }
+
+    /*
+     * Marks the raw block complete, it is then returned by raw() until the
+     * headers are modified.
+     */
+    void complete_raw() {
+        raw_valid_ = true;
+    }
+
+    void invalidate_raw() {
+        raw_valid_ = false;
+    }
+
+    string_ref raw() const {
+        return raw_valid_ ? string_ref(data_.data(), raw_size_) : string_ref();
+    }
+
+    /*
+     * Finds the first header with the name, the name is case-insensitive.
+     */
+    bool find(string_ref name, std::string& value) const {
+        auto i = index_of(name);
+        if (i == npos)
+            return false;
+
+        auto v = this->value(i);
+        value.assign(v.data(), v.size());
+        return true;
+    }
+
+    bool find(header_id id, std::string& value) const {
+        auto i = index_of(id);
+        if (i == npos)
+            return false;
+
+        auto v = this->value(i);
+        value.assign(v.data(), v.size());
+        return true;
+    }
+
+    bool contains(string_ref name) const {
+        return index_of(name) != npos;
+    }
+
+    bool contains(header_id id) const {
+        return index_of(id) != npos;
+    }
+
+    /*
+     * Calls f(value) for each header with the name, in the order they are
+     * added.
+     */
+    template<typename Function>
+    void for_each(string_ref name, Function f) const {
+        auto h = hash(name);
+        for (auto i = buckets_[h % BUCKET_COUNT]; i; i = entries_[i - 1].next) {
+            if (match(i - 1, h, name))
+                f(value(i - 1));
+        }
+    }
+
+    void clear() {
+        data_.clear();
+        entries_.clear();
+        buckets_.fill(0);
+        known_.fill(0);
+        raw_size_ = 0;
+        raw_valid_ = false;
+    }
+
+    static std::uint32_t hash(string_ref name) {
+        // FNV-1a of the lower case name
+        std::uint32_t h = 2166136261u;
+        for (auto c : name) {
+            h ^= static_cast<unsigned char>(to_lower(c));
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    static bool iequals(string_ref s1, string_ref s2) {
+        if (s1.size() != s2.size())
+            return false;
+
+        for (std::size_t i = 0; i < s1.size(); ++i) {
+            if (to_lower(s1[i]) != to_lower(s2[i]))
+                return false;
+        }
+        return true;
+    }
+
+    /*
+     * Returns the index of the first header with the name, or npos.
+     */
+    std::size_t index_of(string_ref name) const {
+        auto h = hash(name);
+        for (auto i = buckets_[h % BUCKET_COUNT]; i; i = entries_[i - 1].next) {
+            if (match(i - 1, h, name))
+                return i - 1;
+        }
+        return npos;
+    }
+
+    std::size_t index_of(header_id id) const {
+        return id != HEADER_UNKNOWN && known_[id] ? known_[id] - 1 : npos;
+    }
+
+private:
+    enum { BUCKET_COUNT = 32 };
+
+    struct entry {
+        std::uint32_t name_offset;
+        std::uint32_t name_size;
+        std::uint32_t value_offset;
+        std::uint32_t value_size;
+        std::uint32_t hash;
+        std::uint32_t id;
+        std::uint32_t next; // index + 1 of the next entry in the chain, 0 for none
+    };
+
+    void add_entry(std::size_t name_offset, std::size_t name_size,
+                   std::size_t value_offset, std::size_t value_size) {
+        string_ref n(data_.data() + name_offset, name_size);
+
+        entry e;
+        e.name_offset = name_offset;
+        e.name_size = name_size;
+        e.value_offset = value_offset;
+        e.value_size = value_size;
+        e.hash = hash(n);
+        e.id = to_header_id(n, e.hash);
+        e.next = 0;
+        entries_.push_back(e);
+
+        auto i = entries_.size() - 1;
+
+        // append to the tail of the chain, so that the chain is in order
+        std::uint32_t *next = &buckets_[e.hash % BUCKET_COUNT];
+        while (*next)
+            next = &entries_[*next - 1].next;
+        *next = i + 1;
+
+        if (e.id != HEADER_UNKNOWN && known_[e.id] == 0)
+            known_[e.id] = i + 1;
+    }
+
+    static char to_lower(char c) {
+        return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+
+    bool match(std::size_t i, std::uint32_t h, string_ref name) const {
+        return entries_[i].hash == h && iequals(this->name(i), name);
+    }
+
+    std::string data_;
+    std::vector<entry> entries_;
+    std::array<std::uint32_t, BUCKET_COUNT> buckets_; // index + 1 of the chain head
+    std::array<std::uint32_t, HEADER_COUNT> known_;   // index + 1 of the first header of each ID
+    std::size_t raw_size_;
+    bool raw_valid_;
+};
+
+} // namespace http
+} // namespace message
+} // namespace x
+
+#endif // HTTP_HEADERS_HPP
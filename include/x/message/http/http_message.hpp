@@ -1,9 +1,9 @@
 #ifndef HTTP_MESSAGE_HPP
 #define HTTP_MESSAGE_HPP
 
-#include <map>
 #include "x/common.hpp"
 #include "x/memory/byte_buffer.hpp"
+#include "x/message/http/http_headers.hpp"
 #include "x/message/message.hpp"
 
 namespace x {
@@ -22,7 +22,13 @@ public:
         headers_completed_ = false;
         message_completed_ = false;
         headers_.clear();
-        body_.clear();
+        body_offset_ = 0;
+
+        // do not keep the storage of a large body for the next message
+        if (body_.capacity() > MAX_RETAINED_BODY_SIZE)
+            body_ = memory::byte_buffer();
+        else
+            body_.clear();
     }
 
     virtual bool completed() const {
@@ -57,30 +63,47 @@ public:
         minor_version_ = version;
     }
 
+    /*
+     * Finds the first header with the name, the name is case-insensitive.
+     */
     bool find_header(const std::string& name, std::string& value) const {
-        for (auto it = headers_.begin(); it != headers_.end(); ++it) {
-            if (it->first == name) {
-                value = it->second;
-                return true;
-            }
-        }
+        return headers_.find(name, value);
+    }
+
+    bool find_header(header_id id, std::string& value) const {
+        return headers_.find(id, value);
+    }
 
-        return false;
+    bool has_header(header_id id) const {
+        return headers_.contains(id);
     }
 
     http_message& add_header(const std::string& name, const std::string& value) {
-        headers_.insert(std::make_pair(name, value));
+        headers_.add(name, value);
         return *this;
     }
 
-    const std::map<std::string, std::string>& get_headers() const {
+    const http_headers& get_headers() const {
         return headers_;
     }
 
-    std::map<std::string, std::string>& get_headers() {
+    http_headers& get_headers() {
+        // the headers may be modified, the raw headers are no longer valid
+        headers_.invalidate_raw();
         return headers_;
     }
 
+    /*
+     * The raw headers are the header lines exactly as received, including
+     * the empty line which ends them. They are forwarded verbatim if the
+     * headers are not modified after decoding, any modification made through
+     * add_header() or get_headers() drops them, the headers are then encoded
+     * one by one.
+     */
+    http_headers::string_ref get_raw_headers() const {
+        return headers_.raw();
+    }
+
     http_message& append_body(const char *data, std::size_t size) {
         body_ << memory::byte_buffer::wrap(data, size);
         return *this;
@@ -91,6 +114,31 @@ public:
         return *this;
     }
 
+    /*
+     * Reserves the storage of a body of the length, so that it is not grown
+     * piece by piece as the body is appended.
+     */
+    void reserve_body(std::size_t length) {
+        body_.reserve(body_.size() + length);
+    }
+
+    /*
+     * Drops the body received so far, it is used when the body is already
+     * forwarded, so that a large body is not kept in memory as a whole.
+     */
+    void discard_body() {
+        body_offset_ += body_.size();
+        body_.clear();
+    }
+
+    /*
+     * Returns the offset of the current body data in the whole body, which
+     * is the size of the body discarded.
+     */
+    std::size_t get_body_offset() const {
+        return body_offset_;
+    }
+
     const memory::byte_buffer& get_body() const {
         return body_;
     }
@@ -102,16 +150,20 @@ public:
 protected:
     http_message()
         : major_version_(0),minor_version_(0),
-          headers_completed_(false), message_completed_(false) {}
+          headers_completed_(false), message_completed_(false),
+          body_offset_(0) {}
 
     int major_version_;
     int minor_version_;
 
 private:
+    enum { MAX_RETAINED_BODY_SIZE = 64 * 1024 };
+
     bool headers_completed_;
     bool message_completed_;
-    std::map<std::string, std::string> headers_;
+    http_headers headers_;
     memory::byte_buffer body_;
+    std::size_t body_offset_;
 
     MAKE_NONCOPYABLE(http_message);
 };
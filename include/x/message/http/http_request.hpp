@@ -22,7 +22,7 @@ public:
         uri_.clear();
     }
 
-    std::string get_method() const {
+    const std::string& get_method() const {
         return method_;
     }
 
@@ -30,7 +30,7 @@ public:
         method_ = method;
     }
 
-    std::string get_uri() const {
+    const std::string& get_uri() const {
         return uri_;
     }
 
@@ -1,6 +1,7 @@
 #ifndef MESSAGE_HPP
 #define MESSAGE_HPP
 
+#include <cassert>
 #include "x/common.hpp"
 
 namespace x {
@@ -17,6 +18,21 @@ public:
     virtual bool completed() const = 0;
 };
 
+/*
+ * Casts a message to its concrete type, which is known by the caller, e.g.
+ * the message decoded by a client connection is always a request. The type
+ * is only checked with RTTI when X_DEBUG_CASTS is defined, as the asserts
+ * are live in all builds, and the codec should do no RTTI lookup for each
+ * read or callback.
+ */
+template<typename T, typename U>
+inline T *message_cast(U *msg) {
+#ifdef X_DEBUG_CASTS
+    assert(dynamic_cast<T *>(msg) == msg);
+#endif
+    return static_cast<T *>(msg);
+}
+
 } // namespace message
 } // namespace x
 
@@ -4,6 +4,7 @@
 #include "x/net/connection.hpp"
 
 namespace x {
+namespace message { namespace http { class http_request; } }
 namespace net {
 
 class client_connection : public connection {
@@ -14,14 +15,29 @@ public:
 
     virtual bool keep_alive();
 
+    /*
+     * Returns the message decoded, which is always an HTTP request.
+     */
+    message::http::http_request& get_request();
+
     virtual void start();
 
     virtual void connect();
 
-    virtual void handshake(ssl::certificate ca = ssl::certificate(), DH *dh = nullptr);
+    virtual void handshake(ssl::ssl_context_ptr ctx = ssl::ssl_context_ptr());
 
     virtual void reset();
 
+    /*
+     * Decodes the next request pipelined while the current one is still in
+     * flight, only if it is received completely, returns false otherwise.
+     * A request not received completely is kept, and decoded when the
+     * connection is reset, so the state of the last request is not lost.
+     */
+    bool decode_pipelined();
+
+    virtual void tunnel();
+
     virtual void on_connect(const boost::system::error_code& e, boost::asio::ip::tcp::resolver::iterator it);
 
     virtual void on_read(const boost::system::error_code& e, const char *data, std::size_t length);
@@ -29,6 +45,26 @@ public:
     virtual void on_write();
 
     virtual void on_handshake(const boost::system::error_code& e);
+
+    virtual void on_drain();
+
+private:
+    bool decode_next();
+    void decode(const char *data, std::size_t length);
+    void keep_pipelined(const char *data, std::size_t length);
+    void deliver();
+
+    // the same object as message_, kept with its concrete type
+    message::http::http_request *request_;
+
+    // the requests received after the one being handled
+    std::string pipelined_;
+
+    // the requests pipelined are decoded by the spare decoder into the spare
+    // message, which are swapped with the current ones if it is complete
+    std::unique_ptr<codec::message_decoder> spare_decoder_;
+    std::unique_ptr<message::message> spare_message_;
+    message::http::http_request *spare_request_;
 };
 
 } // namespace net
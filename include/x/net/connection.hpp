@@ -1,9 +1,12 @@
 #ifndef CONNECTION_HPP
 #define CONNECTION_HPP
 
+#include <atomic>
 #include <boost/asio.hpp>
 #include "x/codec/message_decoder.hpp"
 #include "x/codec/message_encoder.hpp"
+#include "x/memory/buffer_pool.hpp"
+#include "x/memory/buffer_queue.hpp"
 #include "x/memory/byte_buffer.hpp"
 #include "x/message/message.hpp"
 #include "x/net/connection_context.hpp"
@@ -21,28 +24,97 @@ class connection : public util::counter<connection>,
 public:
     connection(context_ptr ctx, connection_manager& mgr);
 
-    virtual ~connection() {
-        XDEBUG_WITH_ID(this) << "connection destructed.";
-    }
+    virtual ~connection();
 
     virtual bool keep_alive() = 0;
 
     virtual void start() = 0;
     virtual void connect() = 0;
-    virtual void handshake(ssl::certificate ca = ssl::certificate(), DH *dh = nullptr) = 0;
+    virtual void handshake(ssl::ssl_context_ptr ctx = ssl::ssl_context_ptr()) = 0;
 
     virtual void read();
     virtual void write();
     virtual void write(const message::message& message);
+    virtual void write(memory::buffer_ptr buf);
+    virtual void write(const char *data, std::size_t size);
+
+    /*
+     * Encodes the message into a buffer without writing it, the encoder must
+     * be reset by reset_encoder() before the next message is encoded.
+     */
+    memory::buffer_ptr encode(const message::message& message);
+
+    void reset_encoder() {
+        encoder_->reset();
+    }
+
     virtual void reset();
 
+    /*
+     * Switches the connection to a tunnel, the bytes read are relayed to the
+     * peer as they are, without being decoded, until either side is closed.
+     */
+    virtual void tunnel();
+
+    bool tunneled() const {
+        return tunneled_;
+    }
+
     virtual void on_connect(const boost::system::error_code& e, boost::asio::ip::tcp::resolver::iterator it) = 0;
     virtual void on_read(const boost::system::error_code& e, const char *data, std::size_t length) = 0;
     virtual void on_write() = 0;
     virtual void on_handshake(const boost::system::error_code& e) = 0;
+    virtual void on_drain() {}
 
     void stop(bool notify = true);
 
+    bool stopped() const {
+        return stopped_;
+    }
+
+    /*
+     * A connection is idle when it is kept alive and waiting for the next
+     * message.
+     */
+    bool idle() const {
+        return idle_;
+    }
+
+    bool ssl() const {
+        return socket_->ssl();
+    }
+
+    /*
+     * Returns the memory held by the connection, except the memory allocated
+     * inside OpenSSL.
+     */
+    std::size_t memory_usage() const;
+
+    /*
+     * Returns the bytes queued but not written yet.
+     */
+    std::size_t pending_bytes() const {
+        return buffer_out_.bytes();
+    }
+
+    /*
+     * Returns true if the bytes pending are above the high watermark, the
+     * peer should then stop reading, until on_drain() is called when the
+     * bytes pending fall to the low watermark.
+     */
+    bool congested();
+
+    /*
+     * Total number of reads done by all connections, and the bytes read.
+     */
+    static std::size_t read_calls() {
+        return read_calls_;
+    }
+
+    static std::size_t read_bytes() {
+        return read_bytes_;
+    }
+
     void detach() {
         manager_ = nullptr;
     }
@@ -80,6 +152,19 @@ public:
     }
 
 protected:
+    /*
+     * Takes over the buffer of the data being handled by on_read(...), so
+     * that the first size bytes can be queued to the peer without a copy.
+     */
+    memory::buffer_ptr take_read_buffer(std::size_t size);
+
+    /*
+     * Relays the first length bytes read to the peer in tunnel mode, the
+     * buffer read is taken over.
+     */
+    void relay(std::size_t length);
+    void relay(memory::buffer_ptr data);
+
     void cancel_timer() {
         XDEBUG_WITH_ID(this) << "cancel running timer.";
         timer_.cancel();
@@ -87,6 +172,7 @@ protected:
 
     bool connected_;
     bool stopped_;
+    bool idle_;
     std::string host_;
     unsigned short port_;
     std::unique_ptr<socket_wrapper> socket_;
@@ -99,14 +185,45 @@ protected:
     connection_manager *manager_;
 
 private:
+    void do_read();
+    void on_ready(const boost::system::error_code& e);
+    void on_read(const boost::system::error_code& e, std::size_t length);
     void do_write();
     void on_write(const boost::system::error_code& e, std::size_t length);
-
-    enum { FIXED_BUFFER_SIZE = 8192 };
-
-    std::array<char, FIXED_BUFFER_SIZE> buffer_in_;
-    std::list<memory::buffer_ptr> buffer_out_;
+    void watch_tunnel();
+
+    enum {
+        TUNNEL_IDLE_TIME = 300, // seconds
+        READ_BUFFER_SIZE = 8192,
+        MAX_READ_BUFFER_SIZE = memory::buffer_pool::MAX_BLOCK_SIZE,
+        HIGH_WATERMARK = 1024 * 1024,
+        LOW_WATERMARK = 256 * 1024
+    };
+
+    // the read buffer is borrowed from the buffer pool only when a read is
+    // in progress, and returned when the data is decoded
+    char *buffer_in_;
+    std::size_t buffer_in_capacity_;
+
+    // the buffer being handled by on_read(...), unless it is taken over
+    char *buffer_read_;
+    std::size_t buffer_read_capacity_;
+
+    // the read size doubles each time a read fills the whole buffer, and
+    // goes back to the initial size when the connection becomes idle
+    std::size_t read_size_;
+
+    static std::atomic<std::size_t> read_calls_;
+    static std::atomic<std::size_t> read_bytes_;
+
+    memory::buffer_queue buffer_out_;
+    bool reading_;
     bool writing_;
+    bool drain_pending_;
+
+    // the tunnel is closed if no byte is relayed either way for a while
+    bool tunneled_;
+    std::size_t tunnel_activity_;
 };
 
 typedef std::shared_ptr<connection> connection_ptr;
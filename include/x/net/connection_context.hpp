@@ -2,14 +2,17 @@
 #define CONNECTION_CONTEXT_HPP
 
 #include <boost/asio.hpp>
+#include "x/codec/http/canned_response.hpp"
 #include "x/common.hpp"
+#include "x/memory/byte_buffer.hpp"
+#include "x/net/request_pipeline.hpp"
 
 namespace x {
-namespace message { class message; namespace http { class http_request; }}
+namespace message { class message; namespace http { class http_request; class http_response; }}
 namespace net {
 
 enum connection_event {
-    CONNECT, READ, HANDSHAKE, WRITE
+    CONNECT, READ, HANDSHAKE, WRITE, DRAIN, TIMEOUT
 };
 
 class server;
@@ -23,6 +26,12 @@ public:
         : https_(false),
           ssl_setup_(false),
           message_exchange_completed_(false),
+          server_read_paused_(false),
+          client_read_paused_(false),
+          response_started_(false),
+          close_client_(false),
+          request_deferred_(false),
+          tunnel_(false),
           server_(svr) {}
 
     boost::asio::io_service& service() const;
@@ -42,16 +51,53 @@ public:
 
     void on_stop(std::shared_ptr<connection> conn);
 
+    /*
+     * Replies a canned error response to the client, and closes the client
+     * connection when the response is written.
+     */
+    void reply_error(client_connection& conn, codec::http::canned_response_type type);
+
+    /*
+     * Called when a piece of a response body is passed through by the server
+     * connection without being decoded.
+     */
+    void on_server_body(memory::buffer_ptr body, server_connection& conn);
+
+    /*
+     * Called when the bytes are read by either connection of a tunnel, they
+     * are written to the other one.
+     */
+    void on_tunnel_data(memory::buffer_ptr data, connection& conn);
+
 private:
-    void on_client_message(message::message& msg);
-    void on_server_message(message::message& msg);
+    void on_client_message(message::http::http_request& request);
+    void on_server_message(message::http::http_response& response);
+    void on_forwarded(bool completed);
+
+    std::shared_ptr<server_connection> connect_server(const std::string& host, unsigned short port);
+    void send_request(server_connection& conn, message::http::http_request& request);
+    void pipeline_next(client_connection& client);
+    bool replay();
+    void start_tunnel();
 
-    void parse_destination(const message::http::http_request& request,
-                           bool& https, std::string& host, unsigned short& port);
+    bool parse_destination(const message::http::http_request& request,
+                          bool& https, std::string& host, unsigned short& port);
 
     bool https_;
     bool ssl_setup_;
     bool message_exchange_completed_;
+    bool server_read_paused_;
+    bool client_read_paused_;
+    bool response_started_;
+    bool close_client_;
+
+    // the requests pipelined to the server, in the order they are written
+    request_pipeline pipeline_;
+    bool request_deferred_;
+
+    // the protocol is switched by a 101 response, the bytes are relayed
+    // both ways from then on
+    bool tunnel_;
 
     server& server_;
     std::weak_ptr<connection> client_conn_;
@@ -24,6 +24,10 @@ public:
         connections_.erase(it);
     }
 
+    const std::set<connection_ptr>& connections() const {
+        return connections_;
+    }
+
     void stop_all() {
         std::for_each(connections_.begin(), connections_.end(),
                       [] (connection_ptr conn) {
@@ -0,0 +1,145 @@
+#ifndef REQUEST_PIPELINE_HPP
+#define REQUEST_PIPELINE_HPP
+
+#include <deque>
+#include "x/common.hpp"
+#include "x/memory/byte_buffer.hpp"
+#include "x/message/http/http_request.hpp"
+
+namespace x {
+namespace net {
+
+/*
+ * The requests pipelined to a server.
+ *
+ * The requests are kept in the order they are written, until their responses
+ * are completed, so the responses are matched to them first in first out.
+ * If the server closes the connection before all of them are responded, they
+ * can be sent again on a new connection, as long as all of them are
+ * idempotent.
+ *
+ * Only the requests after an idempotent one are pipelined, a request which
+ * is not idempotent waits until the pipeline is empty.
+ */
+class request_pipeline {
+public:
+    enum {
+        MAX_IN_FLIGHT = 8,
+        MAX_REPLAYS = 1
+    };
+
+    request_pipeline() : replays_(0) {}
+
+    DEFAULT_DTOR(request_pipeline);
+
+    /*
+     * Only GET is taken as idempotent. HEAD is left out, as the framing of
+     * its response depends on the request, and a request switching the
+     * protocol is never followed by another one.
+     */
+    static bool idempotent(const message::http::http_request& request) {
+        return request.get_method() == "GET" &&
+               !request.has_header(message::http::HEADER_UPGRADE);
+    }
+
+    bool empty() const {
+        return requests_.empty();
+    }
+
+    std::size_t size() const {
+        return requests_.size();
+    }
+
+    bool full() const {
+        return requests_.size() >= MAX_IN_FLIGHT;
+    }
+
+    /*
+     * Returns true if the request can be written now, otherwise it should
+     * wait until the pipeline is empty.
+     */
+    bool accepts(const message::http::http_request& request) const {
+        return requests_.empty() || idempotent(request);
+    }
+
+    /*
+     * Returns true if the next request may be written before the responses
+     * of the requests in flight, keep_alive tells if the client connection
+     * is kept alive after the last request.
+     */
+    bool pipelinable(bool keep_alive) const {
+        return keep_alive && !requests_.empty() && requests_.back().idempotent && !full();
+    }
+
+    void push(memory::buffer_ptr request, bool idempotent) {
+        entry e;
+        e.request = std::move(request);
+        e.idempotent = idempotent;
+        requests_.push_back(std::move(e));
+    }
+
+    /*
+     * Returns the request whose response is expected next.
+     */
+    const memory::byte_buffer& front() const {
+        assert(!requests_.empty());
+        return *requests_.front().request;
+    }
+
+    /*
+     * Called when the response of the first request is completed, the
+     * server has made progress, so the requests left may be sent again.
+     */
+    void pop() {
+        assert(!requests_.empty());
+        requests_.pop_front();
+        replays_ = 0;
+    }
+
+    bool replayable() const {
+        if (requests_.empty() || replays_ >= MAX_REPLAYS)
+            return false;
+
+        for (auto& e : requests_) {
+            if (!e.idempotent)
+                return false;
+        }
+        return true;
+    }
+
+    /*
+     * Returns the requests in flight in one buffer to be sent again. They
+     * are copied, as they may be still in the write queue of the connection
+     * closed, and a buffer can not be in two write queues.
+     */
+    memory::buffer_ptr replay() {
+        assert(replayable());
+        ++replays_;
+
+        auto buf = memory::buffer_cache::local().acquire();
+        for (auto& e : requests_)
+            *buf << memory::byte_buffer::wrap(e.request->data(), e.request->size());
+        return buf;
+    }
+
+    void clear() {
+        requests_.clear();
+        replays_ = 0;
+    }
+
+private:
+    struct entry {
+        memory::buffer_ptr request;
+        bool idempotent;
+    };
+
+    std::deque<entry> requests_;
+    std::size_t replays_;
+
+    MAKE_NONCOPYABLE(request_pipeline);
+};
+
+} // namespace net
+} // namespace x
+
+#endif // REQUEST_PIPELINE_HPP
@@ -14,6 +14,7 @@ namespace net {
 class server {
 public:
     const static unsigned short DEFAULT_SERVER_PORT = 7077;
+    const static std::size_t DEFAULT_WARMUP_COUNT = 100;
 
     server();
 
@@ -43,6 +44,13 @@ public:
         return *server_conn_mgr_;
     }
 
+    /*
+     * Returns true if idempotent requests may be pipelined to the servers.
+     */
+    bool upstream_pipelining() const {
+        return upstream_pipelining_;
+    }
+
 private:
     void init_signal_handler();
 
@@ -50,11 +58,18 @@ private:
 
     void start_accept();
 
+    void start_stats_timer();
+
+    void report_stats();
+
     unsigned short port_;
+    long stats_interval_;
+    bool upstream_pipelining_;
 
     boost::asio::io_service service_;
     boost::asio::signal_set signals_;
     boost::asio::ip::tcp::acceptor acceptor_;
+    boost::asio::deadline_timer stats_timer_;
 
     std::unique_ptr<x::conf::config> config_;
     std::unique_ptr<x::ssl::certificate_manager> cert_manager_;
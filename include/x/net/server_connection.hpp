@@ -4,6 +4,7 @@
 #include "x/net/connection.hpp"
 
 namespace x {
+namespace message { namespace http { class http_response; } }
 namespace net {
 
 class server_connection : public connection {
@@ -14,14 +15,35 @@ public:
 
     virtual bool keep_alive();
 
+    /*
+     * Returns the message decoded, which is always an HTTP response.
+     */
+    message::http::http_response& get_response();
+
     virtual void start();
 
     virtual void connect();
 
-    virtual void handshake(ssl::certificate ca = ssl::certificate(), DH *dh = nullptr);
+    virtual void handshake(ssl::ssl_context_ptr ctx = ssl::ssl_context_ptr());
 
     virtual void reset();
 
+    /*
+     * Prepares for the next response of the requests pipelined, the requests
+     * not written yet are kept, and the bytes already read after the last
+     * response are decoded.
+     */
+    void next_response();
+
+    /*
+     * Returns true if any bytes are read after the response being handled.
+     */
+    bool has_pending() const {
+        return !pending_.empty();
+    }
+
+    virtual void tunnel();
+
     virtual void on_connect(const boost::system::error_code& e, boost::asio::ip::tcp::resolver::iterator it);
 
     virtual void on_read(const boost::system::error_code& e, const char *data, std::size_t length);
@@ -30,10 +52,20 @@ public:
 
     virtual void on_handshake(const boost::system::error_code& e);
 
+    virtual void on_drain();
+
 private:
     void on_resolve(const boost::system::error_code& e, boost::asio::ip::tcp::resolver::iterator it);
+    void decode(const char *data, std::size_t length);
 
     boost::asio::ip::tcp::resolver resolver_;
+    bool started_;
+
+    // the same object as message_, kept with its concrete type
+    message::http::http_response *response_;
+
+    // the bytes read after the response being handled
+    std::string pending_;
 };
 
 } // namespace net
@@ -50,6 +50,18 @@ public:
         return lowest_layer().is_open();
     }
 
+    bool ssl() const {
+        return use_ssl_;
+    }
+
+    /*
+     * Returns the memory held by the wrapper itself, the memory allocated
+     * inside OpenSSL is not counted.
+     */
+    std::size_t memory_usage() const {
+        return sizeof(*this) + sizeof(socket_type) + (use_ssl_ ? sizeof(ssl_socket_ref_type) : 0);
+    }
+
     void close() const {
         if (is_open()) {
             try {
@@ -67,20 +79,18 @@ public:
     }
 
 public:
-    void switch_to_ssl(boost::asio::ssl::stream_base::handshake_type type, ssl::certificate ca, DH *dh) {
+    void switch_to_ssl(boost::asio::ssl::stream_base::handshake_type type, ssl::ssl_context_ptr ctx) {
         assert(!use_ssl_);
 
-        ssl_context_.reset(new ssl_context_type(ssl_context_type::sslv23));
-
         if (type == boost::asio::ssl::stream_base::server) {
-            assert(ca.key() && ca.cert() && dh);
-
-            ssl_context_->set_options(ssl_context_type::default_workarounds
-                                      | ssl_context_type::no_sslv2
-                                      | ssl_context_type::single_dh_use);
-            SSL_CTX_use_certificate(ssl_context_->native_handle(), ca.cert());
-            SSL_CTX_use_PrivateKey(ssl_context_->native_handle(), ca.key());
-            SSL_CTX_set_tmp_dh(ssl_context_->native_handle(), dh);
+            // server side contexts hold the certificates, they are built and
+            // shared by the certificate manager
+            assert(ctx);
+            ssl_context_ = ctx;
+        } else {
+            // the client side context is shared too, the connection creates
+            // its own one only when no context is given
+            ssl_context_ = ctx ? ctx : std::make_shared<ssl_context_type>(ssl_context_type::sslv23);
         }
 
         ssl_socket_.reset(new ssl_socket_ref_type(*socket_, *ssl_context_));
@@ -114,6 +124,16 @@ public:
         boost::asio::async_connect(lowest_layer(), begin, handler);
     }
 
+    /*
+     * Waits until the socket is readable, without reading anything, it is
+     * only available in non-SSL mode.
+     */
+    template<typename ReadHandler>
+    void async_wait_readable(ReadHandler&& handler) {
+        assert(!use_ssl_);
+        socket_->async_read_some(boost::asio::null_buffers(), handler);
+    }
+
     template<typename MutableBufferSequence, typename ReadHandler>
     void async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
         if (use_ssl_)
@@ -144,7 +164,7 @@ private:
     boost::asio::ssl::stream_base::handshake_type handshake_type_;
 
     std::unique_ptr<socket_type> socket_;
-    std::unique_ptr<ssl_context_type> ssl_context_;
+    ssl::ssl_context_ptr ssl_context_;
     std::unique_ptr<ssl_socket_ref_type> ssl_socket_;
 
 private:
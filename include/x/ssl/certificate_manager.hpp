@@ -1,8 +1,15 @@
 #ifndef CERTIFICATE_MANAGER_HPP
 #define CERTIFICATE_MANAGER_HPP
 
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
 #include <openssl/x509.h>
 #include "x/common.hpp"
+#include "x/log/log.hpp"
+#include "x/ssl/certificate_store.hpp"
 
 namespace x {
 namespace ssl {
@@ -20,38 +27,133 @@ public:
         cert_.reset(cert, ::X509_free);
     }
 
+    void share_key(const certificate& other) {
+        key_ = other.key_;
+    }
+
 private:
     std::shared_ptr<EVP_PKEY> key_;
     std::shared_ptr<X509> cert_;
 };
 
+typedef std::shared_ptr<boost::asio::ssl::context> ssl_context_ptr;
+
 class certificate_manager {
 public:
-    certificate_manager() : cert_dir_("cert/"), dh_(nullptr, ::DH_free) {}
+    /*
+     * SAN_NONE:   one certificate per common name, which is the host itself,
+     *             or a wildcard name in some cases, see parse_common_name()
+     * SAN_DOMAIN: one certificate per registrable domain, all the hosts of
+     *             the domain are listed as subject alternative names, the
+     *             certificate is issued again with the same key when a new
+     *             host shows up
+     */
+    enum san_mode {
+        SAN_NONE, SAN_DOMAIN
+    };
+
+    enum {
+        DEFAULT_SAN_MAX_NAMES = 100
+    };
+
+    certificate_manager()
+        : cert_dir_("cert/"), dh_(nullptr, ::DH_free),
+          release_buffers_(false),
+          san_mode_(SAN_NONE), san_max_names_(DEFAULT_SAN_MAX_NAMES),
+          store_(cert_dir_ + "certificates.db"),
+          ready_(false), failed_(false), worker_stopped_(false) {}
+
+    virtual ~certificate_manager();
+
+    /*
+     * Loads the root CA, the DH parameters and the certificate store, nothing
+     * is generated here, so the server can start listening right away. The
+     * manager is ready for SSL only when both the root CA and the DH
+     * parameters are loaded, otherwise they are generated by start().
+     */
+    bool init() {
+        // the store is only a cache, we can still generate certificates
+        // without it
+        if (!store_.open())
+            XWARN << "Certificate store is unavailable.";
 
-    DEFAULT_DTOR(certificate_manager);
+        load_usage();
 
-    bool init() {
-        if (!load_root_ca()) {
-            if (!generate_root_ca())
-                return false;
+        bool root_loaded = load_root_ca();
+        bool dh_loaded = load_dh_parameters();
+        ready_ = root_loaded && dh_loaded;
 
-            save_root_ca();
-        }
+        return true;
+    }
+
+    /*
+     * Starts the background thread, which generates the root CA and the DH
+     * parameters if they are not loaded, then warms up the most used
+     * certificates. The readiness is handed over to the io_service thread, so
+     * ready_ and the pending handlers are never touched concurrently.
+     */
+    void start(boost::asio::io_service& service, std::size_t warmup_count);
 
-        if (!load_dh_parameters()) {
-            if (!generate_dh_parameters())
-                return false;
+    bool ready() const {
+        return ready_;
+    }
 
-            save_dh_parameters();
+    /*
+     * Returns true if the root CA or the DH parameters can not be generated,
+     * the manager will never be ready then.
+     */
+    bool failed() const {
+        return failed_;
+    }
+
+    /*
+     * Invokes the handler when the manager becomes ready, or fails to, with
+     * the readiness as the argument. Must be called in the io_service thread.
+     */
+    template<typename ReadyHandler>
+    void when_ready(ReadyHandler&& handler) {
+        if (ready_ || failed_) {
+            handler(ready_);
+            return;
         }
 
-        return true;
+        pending_.push_back(handler);
+    }
+
+    /*
+     * When enabled, OpenSSL releases the read/write buffers of a connection
+     * whenever they are empty, which is the case for idle connections.
+     */
+    void set_release_buffers(bool release) {
+        release_buffers_ = release;
+    }
+
+    bool release_buffers() const {
+        return release_buffers_;
+    }
+
+    void set_san_mode(san_mode mode, std::size_t max_names) {
+        san_mode_ = mode;
+        san_max_names_ = max_names > 0 ? max_names : 1;
     }
 
     certificate get_certificate(const std::string& host);
     DH *get_dh_parameters() const;
 
+    /*
+     * Returns a server side SSL context for the host, the context is shared
+     * by all the connections to the same common name.
+     */
+    ssl_context_ptr get_context(const std::string& host);
+
+    /*
+     * Returns the client side SSL context, which is shared by all the
+     * connections to servers.
+     */
+    ssl_context_ptr get_client_context();
+
+    bool save_usage(const std::string& file = "cert/usage.txt");
+
 private:
     bool load_root_ca(const std::string& file = "cert/xProxyRootCA.crt");
     bool save_root_ca(const std::string& file = "cert/xProxyRootCA.crt");
@@ -59,23 +161,69 @@ private:
 
     bool load_certificate(const std::string& file, certificate& cert);
     bool save_certificate(const std::string& file, const certificate& cert);
-    bool generate_certificate(const std::string& common_name, certificate& cert);
+    bool generate_certificate(const std::string& common_name,
+                              const std::vector<std::string>& alt_names,
+                              certificate& cert);
+
+    certificate get_certificate(const std::string& host, std::string& name);
+    bool get_domain_certificate(const std::string& host, std::string& name, certificate& cert);
+    bool find_certificate(const std::string& name, certificate& cert);
 
     bool load_dh_parameters(const std::string& file = "cert/dh.pem");
     bool save_dh_parameters(const std::string& file = "cert/dh.pem");
     bool generate_dh_parameters();
 
+    bool prepare();
+    void on_prepared(bool ok);
+
+    /*
+     * Loads the certificates of the most used common names from the store, in
+     * the io_service thread, as the store is not thread-safe.
+     */
+    std::vector<std::pair<std::string, certificate>> load_most_used(std::size_t count);
+
+    /*
+     * Builds the SSL contexts of the certificates loaded, it runs in the
+     * background thread, the results are handed over to the io_service
+     * thread, so the caches are never touched concurrently.
+     */
+    void warm_up(boost::asio::io_service& service,
+                 const std::vector<std::pair<std::string, certificate>>& certs);
+
+    bool load_usage(const std::string& file = "cert/usage.txt");
+    std::vector<std::string> most_used(std::size_t count) const;
+
+    ssl_context_ptr make_context(const certificate& cert) const;
+
     bool generate_key(EVP_PKEY **key);
     bool generate_request(const std::string& common_name, X509_REQ **request, EVP_PKEY **key);
 
     std::string parse_common_name(const std::string& host);
+    std::string parse_domain(const std::string& host);
+    std::vector<std::string> get_alt_names(const certificate& cert);
+    bool add_alt_names(X509 *x509, const std::vector<std::string>& alt_names);
     std::string get_certificate_filename(const std::string& common_name);
 
 private:
     std::string cert_dir_;
     std::unique_ptr<DH, void(*)(DH*)> dh_;
     certificate root_;
+    bool release_buffers_;
+    san_mode san_mode_;
+    std::size_t san_max_names_;
     std::map<std::string, certificate> certificates_;
+    std::map<std::string, ssl_context_ptr> contexts_;
+    ssl_context_ptr client_context_;
+    std::map<std::string, std::string> names_;
+    std::map<std::string, std::size_t> usage_;
+    certificate_store store_;
+
+    bool ready_;
+    bool failed_;
+    std::vector<std::function<void(bool)>> pending_;
+
+    std::thread worker_;
+    std::atomic<bool> worker_stopped_;
 
     MAKE_NONCOPYABLE(certificate_manager);
 };
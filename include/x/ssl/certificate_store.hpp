@@ -0,0 +1,98 @@
+#ifndef CERTIFICATE_STORE_HPP
+#define CERTIFICATE_STORE_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "x/common.hpp"
+
+namespace x {
+namespace ssl {
+
+class certificate;
+
+/*
+ * A single-file certificate store.
+ *
+ * All generated certificates are kept in one file, as a sequence of records:
+ *
+ *     | header | common name | certificate (DER) | private key (DER) |
+ *
+ * The file is memory-mapped when opened, and a hash index from common name to
+ * record offset is built by scanning the records, the certificates themselves
+ * are only decoded when they are looked up.
+ *
+ * New records are always appended to the end of the file and synced, a record
+ * written later supersedes the earlier ones with the same common name, the
+ * superseded records are dropped by compaction when they pile up. A torn
+ * record left by a crash is detected by its checksum, the store is then
+ * compacted, which rewrites the live records into a temporary file and renames
+ * it over the original one. If that fails, the torn bytes are cut off before
+ * the next record is appended, so the later records stay reachable. Nothing is
+ * appended if the file is never scanned successfully.
+ *
+ * The store is not thread-safe, it is only used in the io_service thread.
+ */
+class certificate_store {
+public:
+    certificate_store(const std::string& file)
+        : file_(file), scanned_(false), valid_size_(0), dead_size_(0) {}
+
+    DEFAULT_DTOR(certificate_store);
+
+    bool open();
+
+    bool find(const std::string& common_name, certificate& cert);
+    bool save(const std::string& common_name, const certificate& cert);
+    bool compact();
+
+    std::size_t size() const {
+        return index_.size();
+    }
+
+private:
+    struct record_header {
+        std::uint32_t magic;
+        std::uint32_t name_size;
+        std::uint32_t cert_size;
+        std::uint32_t key_size;
+        std::uint32_t checksum;
+    };
+
+    struct entry {
+        std::size_t offset; // offset of the record header in file
+        std::size_t size;   // size of the whole record
+    };
+
+    enum {
+        RECORD_MAGIC = 0x54524358, // "XCRT"
+        MAX_FIELD_SIZE = 64 * 1024,
+        // the superseded records are dropped by save() once they take half of
+        // the file and at least this size
+        MIN_COMPACT_SIZE = 1024 * 1024
+    };
+
+    bool map();
+    void unmap();
+    bool scan(bool& corrupted);
+    const char *record(const entry& e);
+
+    static std::uint32_t checksum(const char *data, std::size_t size);
+
+    std::string file_;
+    bool scanned_;
+    std::size_t valid_size_;
+    std::size_t dead_size_;
+    std::unique_ptr<boost::interprocess::file_mapping> mapping_;
+    std::unique_ptr<boost::interprocess::mapped_region> region_;
+    std::unordered_map<std::string, entry> index_;
+
+    MAKE_NONCOPYABLE(certificate_store);
+};
+
+} // namespace ssl
+} // namespace x
+
+#endif // CERTIFICATE_STORE_HPP
@@ -0,0 +1,69 @@
+#ifndef ITOA_HPP
+#define ITOA_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace x {
+namespace util {
+
+/*
+ * Returns the number of decimal digits of value.
+ */
+inline std::size_t digits10(std::uint64_t value) {
+    std::size_t n = 1;
+    for (;;) {
+        if (value < 10) return n;
+        if (value < 100) return n + 1;
+        if (value < 1000) return n + 2;
+        if (value < 10000) return n + 3;
+        value /= 10000;
+        n += 4;
+    }
+}
+
+/*
+ * Writes the decimal digits of value to out, which must have room for
+ * digits10(value) bytes, and returns the number of bytes written.
+ *
+ * The digits are written backwards two at a time from a table of the pairs,
+ * so there is only one division for every two digits.
+ */
+inline std::size_t itoa(std::uint64_t value, char *out) {
+    static const char pairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    auto size = digits10(value);
+    auto p = out + size;
+
+    while (value >= 100) {
+        auto i = (value % 100) * 2;
+        value /= 100;
+        *--p = pairs[i + 1];
+        *--p = pairs[i];
+    }
+
+    if (value >= 10) {
+        auto i = value * 2;
+        *--p = pairs[i + 1];
+        *--p = pairs[i];
+    } else {
+        *--p = static_cast<char>('0' + value);
+    }
+
+    return size;
+}
+
+} // namespace util
+} // namespace x
+
+#endif // ITOA_HPP
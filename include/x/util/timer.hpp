@@ -7,9 +7,9 @@ namespace util {
 class timer {
 public:
     timer(boost::asio::io_service& service)
-        : timer_(service),
-          running_(false),
-          triggered_(false) {}
+        : running_(false),
+          triggered_(false),
+          timer_(service) {}
 
     DEFAULT_DTOR(timer);
 
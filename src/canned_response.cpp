@@ -0,0 +1,54 @@
+#include <cassert>
+#include "x/codec/http/canned_response.hpp"
+#include "x/common.hpp"
+
+namespace x {
+namespace codec {
+namespace http {
+
+namespace {
+
+#define ERROR_RESPONSE(status, length, extra) \
+    "HTTP/1.1 " status CRLF \
+    "Content-Type: text/plain" CRLF \
+    "Content-Length: " length CRLF \
+    extra \
+    "Connection: close" CRLF \
+    "Proxy-Connection: close" CRLF \
+    CRLF \
+    status "\n"
+
+#define RETRY_AFTER "Retry-After: 10" CRLF
+
+const char connection_established[] =
+    "HTTP/1.1 200 Connection Established" CRLF
+    "Connection: keep-alive" CRLF
+    "Proxy-Connection: keep-alive" CRLF
+    CRLF;
+
+const char bad_request[] = ERROR_RESPONSE("400 Bad Request", "16", "");
+const char bad_gateway[] = ERROR_RESPONSE("502 Bad Gateway", "16", "");
+const char service_unavailable[] = ERROR_RESPONSE("503 Service Unavailable", "24", RETRY_AFTER);
+const char gateway_timeout[] = ERROR_RESPONSE("504 Gateway Timeout", "20", RETRY_AFTER);
+
+#undef RETRY_AFTER
+#undef ERROR_RESPONSE
+
+const boost::string_ref responses[CANNED_RESPONSE_COUNT] = {
+    boost::string_ref(connection_established, sizeof(connection_established) - 1),
+    boost::string_ref(bad_request, sizeof(bad_request) - 1),
+    boost::string_ref(bad_gateway, sizeof(bad_gateway) - 1),
+    boost::string_ref(service_unavailable, sizeof(service_unavailable) - 1),
+    boost::string_ref(gateway_timeout, sizeof(gateway_timeout) - 1)
+};
+
+} // anonymous namespace
+
+boost::string_ref canned_response(canned_response_type type) {
+    assert(type < CANNED_RESPONSE_COUNT);
+    return responses[type];
+}
+
+} // namespace http
+} // namespace codec
+} // namespace x
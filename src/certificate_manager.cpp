@@ -1,11 +1,107 @@
+#include <fstream>
 #include <boost/date_time.hpp>
 #include <openssl/pem.h>
+#include <openssl/x509v3.h>
 #include "x/log/log.hpp"
 #include "x/ssl/certificate_manager.hpp"
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define ASN1_STRING_get0_data ASN1_STRING_data
+#define BN_GENCB_get_arg(cb) ((cb)->arg)
+#endif
+
 namespace x {
 namespace ssl {
 
+enum {
+    // the max number of common names whose usage are saved
+    MAX_USAGE_RECORDS = 1024
+};
+
+// domain certificates are named with this prefix in the caches and the store,
+// so they never clash with the certificates named by common name
+const char DOMAIN_NAME_PREFIX = '+';
+
+namespace {
+
+// called by OpenSSL while the DH parameters are generated, the generation is
+// aborted once the manager is stopped, so the shutdown does not wait for it
+int on_generate_progress(int, int, BN_GENCB *cb) {
+    auto stopped = static_cast<std::atomic<bool> *>(BN_GENCB_get_arg(cb));
+    return *stopped ? 0 : 1;
+}
+
+} // anonymous namespace
+
+certificate_manager::~certificate_manager() {
+    worker_stopped_ = true;
+    if (worker_.joinable())
+        worker_.join();
+}
+
+void certificate_manager::start(boost::asio::io_service& service, std::size_t warmup_count) {
+    if (ready_ && warmup_count == 0)
+        return;
+
+    if (!ready_)
+        XINFO << "Preparing root CA and DH parameters in background...";
+
+    // usage_ and the store are only touched in the io_service thread, so the
+    // certificates to warm up are loaded before the background thread starts,
+    // which then only builds their SSL contexts
+    bool ready = ready_;
+    auto certs = load_most_used(warmup_count);
+    worker_ = std::thread([this, &service, certs, ready] () {
+        if (!ready) {
+            bool ok = prepare();
+            if (worker_stopped_)
+                return;
+
+            service.post([this, ok] () { on_prepared(ok); });
+            if (!ok)
+                return;
+        }
+
+        warm_up(service, certs);
+    });
+}
+
+bool certificate_manager::prepare() {
+    if (!root_.cert()) {
+        if (!generate_root_ca())
+            return false;
+
+        save_root_ca();
+    }
+
+    if (worker_stopped_)
+        return false;
+
+    if (!dh_) {
+        if (!generate_dh_parameters())
+            return false;
+
+        save_dh_parameters();
+    }
+
+    return true;
+}
+
+void certificate_manager::on_prepared(bool ok) {
+    if (ok) {
+        XINFO << "Root CA and DH parameters are ready.";
+        ready_ = true;
+    } else {
+        XFATAL << "Unable to prepare root CA and DH parameters, SSL is disabled.";
+        failed_ = true;
+    }
+
+    std::vector<std::function<void(bool)>> pending;
+    pending.swap(pending_);
+    for (auto it = pending.begin(); it != pending.end(); ++it)
+        (*it)(ok);
+}
+
 bool certificate_manager::load_root_ca(const std::string& file) {
     if (!load_certificate(file, root_)) {
         XWARN << "Root CA loading error.";
@@ -73,39 +169,279 @@ bool certificate_manager::generate_root_ca() {
 }
 
 certificate certificate_manager::get_certificate(const std::string& host) {
-    auto common_name = parse_common_name(host);
-
-    auto it = certificates_.find(common_name);
-    if (it != certificates_.end())
-        return it->second;
-
-    XDEBUG << "Certificate for " << host << " not found in cache.";
+    std::string name;
+    return get_certificate(host, name);
+}
 
+certificate certificate_manager::get_certificate(const std::string& host, std::string& name) {
     certificate cert;
+    if (san_mode_ == SAN_DOMAIN && get_domain_certificate(host, name, cert))
+        return cert;
 
-    auto filename = get_certificate_filename(common_name);
-    if (load_certificate(filename, cert)) {
-        XDEBUG << "Certificate for host " << host << " loaded from file.";
-        certificates_.insert(std::make_pair(common_name, cert));
+    name = parse_common_name(host);
+    if (find_certificate(name, cert))
         return cert;
-    }
 
     XDEBUG << "Generating certificate for " << host << "...";
 
-    if (!generate_certificate(common_name, cert)) {
+    if (!generate_certificate(name, std::vector<std::string>(), cert)) {
         XERROR << "Certificate generation error, host: " << host;
         return cert;
     }
 
     XDEBUG << "Certificate for " << host << " generated.";
 
-    certificates_.insert(std::make_pair(common_name, cert));
-    if (!save_certificate(filename, cert))
+    certificates_.insert(std::make_pair(name, cert));
+    if (!store_.save(name, cert))
         XERROR << "Certificate saving error, host: " << host;
 
     return cert;
 }
 
+bool certificate_manager::get_domain_certificate(const std::string& host, std::string& name, certificate& cert) {
+    auto domain = parse_domain(host);
+    if (domain.empty())
+        return false;
+
+    name = DOMAIN_NAME_PREFIX + domain;
+
+    certificate current;
+    std::vector<std::string> alt_names;
+    if (find_certificate(name, current)) {
+        if (::X509_check_host(current.cert(), host.c_str(), host.length(), 0, nullptr) == 1) {
+            cert = current;
+            return true;
+        }
+
+        alt_names = get_alt_names(current);
+        if (alt_names.size() >= san_max_names_) {
+            XDEBUG << "Certificate of domain " << domain << " is full, "
+                   << "a separate certificate is used for " << host;
+            return false;
+        }
+    }
+
+    alt_names.push_back(host);
+
+    XDEBUG << "Issuing certificate of domain " << domain << " for " << host << "...";
+
+    // the key of the current certificate is reused, the new certificate just
+    // adds one more alternative name to it
+    certificate issued;
+    issued.share_key(current);
+    if (!generate_certificate(domain, alt_names, issued)) {
+        XERROR << "Certificate generation error, domain: " << domain << ", host: " << host;
+        return false;
+    }
+
+    certificates_[name] = issued;
+    contexts_.erase(name);
+    if (!store_.save(name, issued))
+        XERROR << "Certificate saving error, domain: " << domain;
+
+    cert = issued;
+    return true;
+}
+
+bool certificate_manager::find_certificate(const std::string& name, certificate& cert) {
+    auto it = certificates_.find(name);
+    if (it != certificates_.end()) {
+        cert = it->second;
+        return true;
+    }
+
+    XDEBUG << "Certificate of " << name << " not found in cache.";
+
+    if (store_.find(name, cert)) {
+        XDEBUG << "Certificate of " << name << " loaded from store.";
+        certificates_.insert(std::make_pair(name, cert));
+        return true;
+    }
+
+    // certificates saved by earlier versions are kept in separate files,
+    // import them into the store when they are used
+    auto filename = get_certificate_filename(name);
+    if (load_certificate(filename, cert)) {
+        XDEBUG << "Certificate of " << name << " loaded from file.";
+        certificates_.insert(std::make_pair(name, cert));
+        if (!store_.save(name, cert))
+            XERROR << "Certificate importing error, name: " << name;
+        return true;
+    }
+
+    return false;
+}
+
+ssl_context_ptr certificate_manager::get_context(const std::string& host) {
+    // the certificate name of a host does not change once it is resolved, as
+    // a domain certificate is only issued again with more names added
+    auto name_it = names_.find(host);
+    if (name_it != names_.end()) {
+        auto it = contexts_.find(name_it->second);
+        if (it != contexts_.end()) {
+            ++usage_[name_it->second];
+            return it->second;
+        }
+    }
+
+    std::string name;
+    auto cert = get_certificate(host, name);
+    if (!cert.cert() || !cert.key())
+        return ssl_context_ptr();
+
+    names_[host] = name;
+    ++usage_[name];
+
+    auto it = contexts_.find(name);
+    if (it != contexts_.end())
+        return it->second;
+
+    auto ctx = make_context(cert);
+    if (ctx)
+        contexts_.insert(std::make_pair(name, ctx));
+
+    return ctx;
+}
+
+std::vector<std::pair<std::string, certificate>> certificate_manager::load_most_used(std::size_t count) {
+    std::vector<std::pair<std::string, certificate>> certs;
+    if (count == 0)
+        return certs;
+
+    auto names = most_used(count);
+    for (auto it = names.begin(); it != names.end(); ++it) {
+        certificate cert;
+        if (store_.find(*it, cert))
+            certs.push_back(std::make_pair(*it, cert));
+    }
+
+    return certs;
+}
+
+void certificate_manager::warm_up(boost::asio::io_service& service,
+                                  const std::vector<std::pair<std::string, certificate>>& certs) {
+    if (certs.empty())
+        return;
+
+    XINFO << "Warming up " << certs.size() << " certificates in background...";
+
+    std::size_t loaded = 0;
+    for (auto it = certs.begin(); it != certs.end() && !worker_stopped_; ++it) {
+        auto ctx = make_context(it->second);
+        if (!ctx)
+            continue;
+
+        auto common_name = it->first;
+        auto cert = it->second;
+        service.post([this, common_name, cert, ctx] () {
+            // do not override the certificate issued in the meantime
+            if (certificates_.insert(std::make_pair(common_name, cert)).second)
+                contexts_.insert(std::make_pair(common_name, ctx));
+        });
+        ++loaded;
+    }
+
+    XINFO << "Certificate warm-up finished, " << loaded << " loaded.";
+}
+
+bool certificate_manager::save_usage(const std::string& file) {
+    std::ofstream out(file.c_str(), std::ios::out | std::ios::trunc);
+    if (!out) {
+        XWARN << "Error opening usage file: " << file;
+        return false;
+    }
+
+    auto names = most_used(MAX_USAGE_RECORDS);
+    for (auto it = names.begin(); it != names.end(); ++it)
+        out << usage_[*it] << ' ' << *it << '\n';
+
+    out.close();
+    if (!out) {
+        XERROR << "Error writing usage file: " << file;
+        return false;
+    }
+
+    XINFO << "Usage of " << names.size() << " common names saved.";
+    return true;
+}
+
+bool certificate_manager::load_usage(const std::string& file) {
+    std::ifstream in(file.c_str());
+    if (!in) {
+        XDEBUG << "Usage file " << file << " does not exist.";
+        return false;
+    }
+
+    std::size_t count;
+    std::string common_name;
+    while (in >> count >> common_name)
+        usage_[common_name] += count;
+
+    XINFO << "Usage of " << usage_.size() << " common names loaded.";
+    return true;
+}
+
+std::vector<std::string> certificate_manager::most_used(std::size_t count) const {
+    typedef std::pair<std::size_t, std::string> usage_type;
+
+    std::vector<usage_type> usage;
+    usage.reserve(usage_.size());
+    for (auto it = usage_.begin(); it != usage_.end(); ++it)
+        usage.push_back(std::make_pair(it->second, it->first));
+
+    count = std::min(count, usage.size());
+    std::partial_sort(usage.begin(), usage.begin() + count, usage.end(),
+                      [] (const usage_type& lhs, const usage_type& rhs) {
+        return lhs.first > rhs.first;
+    });
+
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+        names.push_back(usage[i].second);
+
+    return names;
+}
+
+ssl_context_ptr certificate_manager::make_context(const certificate& cert) const {
+    typedef boost::asio::ssl::context context_type;
+
+    ssl_context_ptr ctx(new context_type(context_type::sslv23));
+    ctx->set_options(context_type::default_workarounds
+                     | context_type::no_sslv2
+                     | context_type::single_dh_use);
+
+    if (SSL_CTX_use_certificate(ctx->native_handle(), cert.cert()) != 1 ||
+        SSL_CTX_use_PrivateKey(ctx->native_handle(), cert.key()) != 1) {
+        XERROR << "Error setting certificate to SSL context.";
+        return ssl_context_ptr();
+    }
+
+    if (dh_)
+        SSL_CTX_set_tmp_dh(ctx->native_handle(), dh_.get());
+
+    if (release_buffers_)
+        SSL_CTX_set_mode(ctx->native_handle(), SSL_MODE_RELEASE_BUFFERS);
+
+    return ctx;
+}
+
+ssl_context_ptr certificate_manager::get_client_context() {
+    typedef boost::asio::ssl::context context_type;
+
+    if (client_context_)
+        return client_context_;
+
+    client_context_ = std::make_shared<context_type>(context_type::sslv23);
+    client_context_->set_options(context_type::default_workarounds
+                                 | context_type::no_sslv2);
+
+    if (release_buffers_)
+        SSL_CTX_set_mode(client_context_->native_handle(), SSL_MODE_RELEASE_BUFFERS);
+
+    return client_context_;
+}
+
 bool certificate_manager::load_certificate(const std::string& file, certificate& cert) {
     FILE *fp = std::fopen(file.c_str(), "rb");
     if(!fp) {
@@ -158,14 +494,19 @@ bool certificate_manager::save_certificate(const std::string& file, const certif
     return true;
 }
 
-bool certificate_manager::generate_certificate(const std::string& common_name, certificate& cert) {
+bool certificate_manager::generate_certificate(const std::string& common_name,
+                                               const std::vector<std::string>& alt_names,
+                                               certificate& cert) {
     if(!root_.key() || !root_.cert()) {
         XERROR << "Root CA does not exist.";
         return false;
     }
 
+    // the key already in cert is reused, so no key generation is needed when
+    // a certificate is issued again with more alternative names
+    bool reuse_key = cert.key() != nullptr;
     X509_REQ *req = nullptr;
-    EVP_PKEY *key = nullptr;
+    EVP_PKEY *key = cert.key();
 
     if(!generate_request(common_name, &req, &key)) {
         XERROR << "Error generating request for common name " << common_name;
@@ -174,7 +515,7 @@ bool certificate_manager::generate_certificate(const std::string& common_name, c
 
     if(X509_REQ_verify(req, key) != 1) {
         XERROR << "Error verifying certificate request for common name " << common_name;
-        EVP_PKEY_free(key);
+        if (!reuse_key) EVP_PKEY_free(key);
         X509_REQ_free(req);
         return false;
     }
@@ -182,7 +523,7 @@ bool certificate_manager::generate_certificate(const std::string& common_name, c
     X509 *x509 = X509_new();
     if(!x509) {
         XERROR << "X509 creation error.";
-        EVP_PKEY_free(key);
+        if (!reuse_key) EVP_PKEY_free(key);
         X509_REQ_free(req);
         return false;
     }
@@ -202,18 +543,27 @@ bool certificate_manager::generate_certificate(const std::string& common_name, c
     X509_gmtime_adj(X509_get_notBefore(x509), 0);
     X509_gmtime_adj(X509_get_notAfter(x509), 60 * 60 * 24 * 365 * 10);
 
+    if (!alt_names.empty() && !add_alt_names(x509, alt_names)) {
+        XERROR << "Error adding alternative names for common name " << common_name;
+        if (!reuse_key) EVP_PKEY_free(key);
+        X509_REQ_free(req);
+        X509_free(x509);
+        return false;
+    }
+
     if (!X509_sign(x509, root_.key(), EVP_sha1())) {
         XERROR << "Error signing certificate.";
-        EVP_PKEY_free(key);
+        if (!reuse_key) EVP_PKEY_free(key);
         X509_REQ_free(req);
         X509_free(x509);
         return false;
     }
 
     cert.set_cert(x509);
-    cert.set_key(key);
+    if (!reuse_key) cert.set_key(key);
     X509_REQ_free(req);
-    XINFO << "Certificate generated for common name " << common_name;
+    XINFO << "Certificate generated for common name " << common_name
+          << ", alternative names: " << alt_names.size();
     return true;
 }
 
@@ -260,9 +610,35 @@ bool certificate_manager::save_dh_parameters(const std::string& file) {
 }
 
 bool certificate_manager::generate_dh_parameters(){
-    DH *dh = DH_generate_parameters(512, DH_GENERATOR_2, nullptr, nullptr); // 512 bits
+    DH *dh = DH_new();
     if(!dh) {
-        XERROR << "Error generating DH parameters.";
+        XERROR << "DH creation error.";
+        return false;
+    }
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    BN_GENCB gencb;
+    BN_GENCB *cb = &gencb;
+#else
+    BN_GENCB *cb = BN_GENCB_new();
+    if(!cb) {
+        XERROR << "BN_GENCB creation error.";
+        DH_free(dh);
+        return false;
+    }
+#endif
+    BN_GENCB_set(cb, on_generate_progress, &worker_stopped_);
+
+    int ok = DH_generate_parameters_ex(dh, 512, DH_GENERATOR_2, cb); // 512 bits
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    BN_GENCB_free(cb);
+#endif
+    if(!ok) {
+        if (worker_stopped_)
+            XINFO << "DH parameters generation aborted.";
+        else
+            XERROR << "Error generating DH parameters.";
+        DH_free(dh);
         return false;
     }
     dh_.reset(dh);
@@ -296,8 +672,10 @@ bool certificate_manager::generate_key(EVP_PKEY **key) {
 }
 
 bool certificate_manager::generate_request(const std::string& common_name, X509_REQ **request, EVP_PKEY **key) {
-    EVP_PKEY *k = nullptr;
-    if (!generate_key(&k)) {
+    // a key is generated only when it is not given
+    bool reuse_key = *key != nullptr;
+    EVP_PKEY *k = *key;
+    if (!reuse_key && !generate_key(&k)) {
         XERROR << "Key generation error.";
         return false;
     }
@@ -305,7 +683,7 @@ bool certificate_manager::generate_request(const std::string& common_name, X509_
     X509_REQ *req = X509_REQ_new();
     if (!req) {
         XERROR << "X509_REQ creation error.";
-        EVP_PKEY_free(k);
+        if (!reuse_key) EVP_PKEY_free(k);
         return false;
     }
     X509_REQ_set_pubkey(req, k);
@@ -320,7 +698,7 @@ bool certificate_manager::generate_request(const std::string& common_name, X509_
 
     if (!X509_REQ_sign(req, k, EVP_sha1())) {
         XERROR << "Error signing request.";
-        EVP_PKEY_free(k);
+        if (!reuse_key) EVP_PKEY_free(k);
         X509_REQ_free(req);
         return false;
     }
@@ -347,6 +725,84 @@ std::string certificate_manager::parse_common_name(const std::string& host) {
     return common_name;
 }
 
+/*
+ * A simple heuristic rather than the Public Suffix List: the domain is the last
+ * two labels, or three if they look like "com.cn" or "co.uk", i.e. a short
+ * label under a two-letter top-level domain. It is wrong for the other public
+ * suffixes, e.g. hosts under "github.io" are grouped into one certificate, and
+ * for short registrable names under country codes, e.g. "www.ab.de" is taken
+ * as a domain of its own.
+ */
+std::string certificate_manager::parse_domain(const std::string& host) {
+    // IP addresses are not grouped, they are not valid DNS names
+    if (host.find_first_not_of("0123456789.") == std::string::npos ||
+        host.find(':') != std::string::npos)
+        return std::string();
+
+    auto last = host.find_last_of('.');
+    if (last == std::string::npos || last == 0)
+        return std::string();
+
+    auto penult = host.find_last_of('.', last - 1);
+    if (penult == std::string::npos) // means something like "something.com"
+        return host;
+
+    // means something like "something.com.cn", one more label is needed
+    if (last - penult <= 4 && host.length() - last <= 3) {
+        auto antepenult = penult > 0 ? host.find_last_of('.', penult - 1) : std::string::npos;
+        return antepenult == std::string::npos ? host : host.substr(antepenult + 1);
+    }
+
+    return host.substr(penult + 1);
+}
+
+std::vector<std::string> certificate_manager::get_alt_names(const certificate& cert) {
+    std::vector<std::string> alt_names;
+
+    auto names = static_cast<GENERAL_NAMES *>(::X509_get_ext_d2i(cert.cert(), NID_subject_alt_name, nullptr, nullptr));
+    if (names) {
+        for (int i = 0; i < sk_GENERAL_NAME_num(names); ++i) {
+            GENERAL_NAME *name = sk_GENERAL_NAME_value(names, i);
+            if (name->type != GEN_DNS)
+                continue;
+
+            auto data = reinterpret_cast<const char *>(ASN1_STRING_get0_data(name->d.dNSName));
+            alt_names.push_back(std::string(data, ASN1_STRING_length(name->d.dNSName)));
+        }
+        GENERAL_NAMES_free(names);
+    }
+
+    // certificate without alternative names is matched by its common name
+    if (alt_names.empty()) {
+        char common_name[256];
+        int length = ::X509_NAME_get_text_by_NID(X509_get_subject_name(cert.cert()),
+                                                 NID_commonName, common_name, sizeof(common_name));
+        if (length > 0)
+            alt_names.push_back(std::string(common_name, length));
+    }
+
+    return alt_names;
+}
+
+bool certificate_manager::add_alt_names(X509 *x509, const std::vector<std::string>& alt_names) {
+    std::string value;
+    for (auto it = alt_names.begin(); it != alt_names.end(); ++it) {
+        if (!value.empty())
+            value.append(1, ',');
+        value.append("DNS:").append(*it);
+    }
+
+    X509V3_CTX ctx;
+    X509V3_set_ctx(&ctx, root_.cert(), x509, nullptr, nullptr, 0);
+    X509_EXTENSION *ext = ::X509V3_EXT_conf_nid(nullptr, &ctx, NID_subject_alt_name, const_cast<char *>(value.c_str()));
+    if (!ext)
+        return false;
+
+    int ret = ::X509_add_ext(x509, ext, -1);
+    ::X509_EXTENSION_free(ext);
+    return ret == 1;
+}
+
 std::string certificate_manager::get_certificate_filename(const std::string& common_name) {
     // TODO enhance this function
     std::string filename(common_name);
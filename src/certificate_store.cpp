@@ -0,0 +1,363 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <openssl/x509.h>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "x/log/log.hpp"
+#include "x/ssl/certificate_manager.hpp"
+#include "x/ssl/certificate_store.hpp"
+
+namespace x {
+namespace ssl {
+
+namespace {
+
+std::size_t file_size(const std::string& file) {
+    FILE *fp = std::fopen(file.c_str(), "rb");
+    if (!fp)
+        return 0;
+
+    std::fseek(fp, 0, SEEK_END);
+    long size = std::ftell(fp);
+    std::fclose(fp);
+    return size > 0 ? static_cast<std::size_t>(size) : 0;
+}
+
+bool sync_file(FILE *fp) {
+    if (std::fflush(fp) != 0)
+        return false;
+#ifdef WIN32
+    return ::_commit(::_fileno(fp)) == 0;
+#else
+    return ::fsync(::fileno(fp)) == 0;
+#endif
+}
+
+bool truncate_file(FILE *fp, std::size_t size) {
+#ifdef WIN32
+    return ::_chsize_s(::_fileno(fp), size) == 0;
+#else
+    return ::ftruncate(::fileno(fp), size) == 0;
+#endif
+}
+
+} // anonymous namespace
+
+bool certificate_store::open() {
+    scanned_ = false;
+
+    // make sure the file exists, otherwise it can not be mapped
+    FILE *fp = std::fopen(file_.c_str(), "ab");
+    if (!fp) {
+        XWARN << "Error opening certificate store: " << file_;
+        return false;
+    }
+    std::fclose(fp);
+
+    index_.clear();
+    valid_size_ = 0;
+    dead_size_ = 0;
+
+    if (!map())
+        return false;
+
+    bool corrupted = false;
+    if (!scan(corrupted))
+        return false;
+
+    // the valid records are known from now on, so new ones can be appended
+    // after them, even if the compaction below fails
+    scanned_ = true;
+
+    if (corrupted) {
+        XWARN << "Certificate store " << file_ << " is corrupted at offset "
+              << valid_size_ << ", compacting...";
+        if (!compact())
+            return false;
+    } else if (dead_size_ > 0 && dead_size_ >= valid_size_ / 2) {
+        XINFO << "Certificate store " << file_ << " has " << dead_size_
+              << " bytes superseded, compacting...";
+        if (!compact())
+            return false;
+    }
+
+    XINFO << "Certificate store " << file_ << " opened, "
+          << index_.size() << " certificates indexed.";
+    return true;
+}
+
+bool certificate_store::find(const std::string& common_name, certificate& cert) {
+    auto it = index_.find(common_name);
+    if (it == index_.end())
+        return false;
+
+    auto data = record(it->second);
+    if (!data) {
+        XERROR << "Error reading record of " << common_name << " from " << file_;
+        return false;
+    }
+
+    record_header header;
+    std::memcpy(&header, data, sizeof(header));
+
+    auto p = reinterpret_cast<const unsigned char *>(data + sizeof(header) + header.name_size);
+    X509 *x509 = ::d2i_X509(nullptr, &p, header.cert_size);
+    if (!x509) {
+        XERROR << "Error decoding certificate of " << common_name;
+        return false;
+    }
+
+    EVP_PKEY *key = ::d2i_AutoPrivateKey(nullptr, &p, header.key_size);
+    if (!key) {
+        XERROR << "Error decoding private key of " << common_name;
+        ::X509_free(x509);
+        return false;
+    }
+
+    cert.set_cert(x509);
+    cert.set_key(key);
+    return true;
+}
+
+bool certificate_store::save(const std::string& common_name, const certificate& cert) {
+    int cert_size = ::i2d_X509(cert.cert(), nullptr);
+    int key_size = ::i2d_PrivateKey(cert.key(), nullptr);
+    if (cert_size <= 0 || key_size <= 0) {
+        XERROR << "Error encoding certificate of " << common_name;
+        return false;
+    }
+
+    record_header header;
+    header.magic = RECORD_MAGIC;
+    header.name_size = common_name.size();
+    header.cert_size = cert_size;
+    header.key_size = key_size;
+
+    std::vector<char> payload(header.name_size + cert_size + key_size);
+    std::memcpy(payload.data(), common_name.data(), header.name_size);
+    auto p = reinterpret_cast<unsigned char *>(payload.data() + header.name_size);
+    ::i2d_X509(cert.cert(), &p);
+    ::i2d_PrivateKey(cert.key(), &p);
+    header.checksum = checksum(payload.data(), payload.size());
+
+    if (!scanned_) {
+        XWARN << "Certificate store " << file_ << " is not opened, certificate of "
+              << common_name << " not saved.";
+        return false;
+    }
+
+    FILE *fp = std::fopen(file_.c_str(), "ab");
+    if (!fp) {
+        XWARN << "Error opening certificate store: " << file_;
+        return false;
+    }
+
+    std::fseek(fp, 0, SEEK_END);
+    long offset = std::ftell(fp);
+
+    // a torn record, left by a failed append or a crash, is cut off, or the
+    // records appended after it are never reached by scan()
+    if (offset >= 0 && static_cast<std::size_t>(offset) != valid_size_) {
+        XWARN << "Certificate store " << file_ << " has " << offset - static_cast<long>(valid_size_)
+              << " bytes after the last valid record, truncating...";
+        if (static_cast<std::size_t>(offset) < valid_size_ || !truncate_file(fp, valid_size_)) {
+            XERROR << "Error truncating certificate store " << file_;
+            std::fclose(fp);
+            return false;
+        }
+        std::fseek(fp, 0, SEEK_END);
+        offset = std::ftell(fp);
+    }
+
+    if (offset < 0 ||
+        std::fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        std::fwrite(payload.data(), payload.size(), 1, fp) != 1 ||
+        !sync_file(fp)) {
+        XERROR << "Error appending certificate of " << common_name << " to " << file_;
+        std::fclose(fp);
+        return false;
+    }
+    std::fclose(fp);
+
+    entry e = { static_cast<std::size_t>(offset), sizeof(header) + payload.size() };
+    auto it = index_.find(common_name);
+    if (it != index_.end()) {
+        dead_size_ += it->second.size;
+        it->second = e;
+    } else {
+        index_.insert(std::make_pair(common_name, e));
+    }
+    valid_size_ = e.offset + e.size;
+
+    XDEBUG << "Certificate of " << common_name << " appended to " << file_;
+
+    // a domain certificate is saved again each time a host is added to it, so
+    // the file would grow quadratically with the hosts if never compacted,
+    // the record is saved anyway if the compaction fails
+    if (dead_size_ >= MIN_COMPACT_SIZE && dead_size_ >= valid_size_ / 2) {
+        XINFO << "Certificate store " << file_ << " has " << dead_size_
+              << " bytes superseded, compacting...";
+        compact();
+    }
+
+    return true;
+}
+
+bool certificate_store::compact() {
+    auto tmp = file_ + ".tmp";
+    FILE *fp = std::fopen(tmp.c_str(), "wb");
+    if (!fp) {
+        XERROR << "Error opening file: " << tmp;
+        return false;
+    }
+
+    std::unordered_map<std::string, entry> index;
+    std::size_t offset = 0;
+    for (auto it = index_.begin(); it != index_.end(); ++it) {
+        auto data = record(it->second);
+        if (!data || std::fwrite(data, it->second.size, 1, fp) != 1) {
+            XERROR << "Error compacting record of " << it->first;
+            std::fclose(fp);
+            std::remove(tmp.c_str());
+            return false;
+        }
+
+        entry e = { offset, it->second.size };
+        index.insert(std::make_pair(it->first, e));
+        offset += e.size;
+    }
+
+    if (!sync_file(fp)) {
+        XERROR << "Error syncing file: " << tmp;
+        std::fclose(fp);
+        std::remove(tmp.c_str());
+        return false;
+    }
+    std::fclose(fp);
+
+    // the mapping must be released before the file is replaced
+    unmap();
+#ifdef WIN32
+    std::remove(file_.c_str());
+#endif
+    if (std::rename(tmp.c_str(), file_.c_str()) != 0) {
+        XERROR << "Error renaming " << tmp << " to " << file_;
+        map();
+        return false;
+    }
+
+    index_.swap(index);
+    valid_size_ = offset;
+    dead_size_ = 0;
+
+    XINFO << "Certificate store " << file_ << " compacted, size: " << valid_size_;
+    return map();
+}
+
+bool certificate_store::map() {
+    using namespace boost::interprocess;
+
+    unmap();
+
+    // an empty file can not be mapped, there is nothing to read anyway
+    if (file_size(file_) == 0)
+        return true;
+
+    try {
+        mapping_.reset(new file_mapping(file_.c_str(), read_only));
+        region_.reset(new mapped_region(*mapping_, read_only));
+    } catch (interprocess_exception& e) {
+        XERROR << "Error mapping certificate store " << file_ << ", reason: " << e.what();
+        unmap();
+        return false;
+    }
+
+    return true;
+}
+
+void certificate_store::unmap() {
+    region_.reset();
+    mapping_.reset();
+}
+
+bool certificate_store::scan(bool& corrupted) {
+    corrupted = false;
+    if (!region_)
+        return true;
+
+    auto begin = static_cast<const char *>(region_->get_address());
+    auto size = region_->get_size();
+    std::size_t offset = 0;
+
+    while (offset < size) {
+        record_header header;
+        if (size - offset < sizeof(header)) {
+            corrupted = true;
+            break;
+        }
+        std::memcpy(&header, begin + offset, sizeof(header));
+
+        if (header.magic != RECORD_MAGIC ||
+            header.name_size == 0 || header.name_size > MAX_FIELD_SIZE ||
+            header.cert_size == 0 || header.cert_size > MAX_FIELD_SIZE ||
+            header.key_size == 0 || header.key_size > MAX_FIELD_SIZE) {
+            corrupted = true;
+            break;
+        }
+
+        std::size_t payload_size = header.name_size + header.cert_size + header.key_size;
+        if (size - offset - sizeof(header) < payload_size) {
+            corrupted = true;
+            break;
+        }
+
+        auto payload = begin + offset + sizeof(header);
+        if (checksum(payload, payload_size) != header.checksum) {
+            corrupted = true;
+            break;
+        }
+
+        entry e = { offset, sizeof(header) + payload_size };
+        std::string common_name(payload, header.name_size);
+        auto it = index_.find(common_name);
+        if (it != index_.end()) {
+            dead_size_ += it->second.size;
+            it->second = e;
+        } else {
+            index_.insert(std::make_pair(common_name, e));
+        }
+
+        offset += e.size;
+    }
+
+    valid_size_ = offset;
+    return true;
+}
+
+const char *certificate_store::record(const entry& e) {
+    // records appended after the file is mapped are not visible in the
+    // current mapping, map the file again to see them
+    if (!region_ || e.offset + e.size > region_->get_size()) {
+        if (!map() || !region_ || e.offset + e.size > region_->get_size())
+            return nullptr;
+    }
+
+    return static_cast<const char *>(region_->get_address()) + e.offset;
+}
+
+std::uint32_t certificate_store::checksum(const char *data, std::size_t size) {
+    // FNV-1a, it is enough to detect torn writes
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+} // namespace ssl
+} // namespace x
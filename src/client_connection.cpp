@@ -1,4 +1,4 @@
-#include "x/codec/http/http_decoder.hpp"
+#include "x/codec/http/decoder_factory.hpp"
 #include "x/codec/http/http_encoder.hpp"
 #include "x/message/http/http_request.hpp"
 #include "x/net/client_connection.hpp"
@@ -14,20 +14,26 @@ enum {
 };
 
 client_connection::client_connection(context_ptr ctx, connection_manager& mgr)
-    : connection(ctx, mgr) {
-    decoder_.reset(new codec::http::http_decoder(HTTP_REQUEST));
+    : connection(ctx, mgr),
+      spare_request_(nullptr) {
+    decoder_.reset(codec::http::make_decoder(HTTP_REQUEST));
     encoder_.reset(new codec::http::http_encoder(HTTP_RESPONSE));
-    message_.reset(new message::http::http_request);
+    request_ = new message::http::http_request;
+    message_.reset(request_);
     XDEBUG_WITH_ID(this) << "new client connection";
 }
 
+message::http::http_request& client_connection::get_request() {
+    return *request_;
+}
+
 bool client_connection::keep_alive() {
-    codec::message_decoder *decoder = decoder_.get();
-    return dynamic_cast<codec::http::http_decoder *>(decoder)->keep_alive();
+    return decoder_->keep_alive();
 }
 
 void client_connection::start() {
     connected_ = true;
+    idle_ = true;
 
     auto self(shared_from_this());
     context_->set_client_connection(self);
@@ -39,14 +45,14 @@ void client_connection::connect() {
     ASSERT_EXEC_RETNONE(0, stop);
 }
 
-void client_connection::handshake(ssl::certificate ca, DH *dh) {
+void client_connection::handshake(ssl::ssl_context_ptr ctx) {
     XDEBUG_WITH_ID(this) << "=> handshake()";
 
     auto callback = std::bind(&connection::on_handshake,
                               shared_from_this(),
                               std::placeholders::_1);
 
-    socket_->switch_to_ssl(boost::asio::ssl::stream_base::server, ca, dh);
+    socket_->switch_to_ssl(boost::asio::ssl::stream_base::server, ctx);
     socket_->async_handshake(callback);
 
     XDEBUG_WITH_ID(this) << "<= handshake()";
@@ -63,6 +69,20 @@ void client_connection::reset() {
     message_->reset();
 
     auto self(shared_from_this());
+
+    // the next request is already received, it is decoded instead of reading
+    if (!pipelined_.empty()) {
+        auto task = [self, this] () {
+            if (stopped_)
+                return;
+
+            idle_ = false;
+            decode_next();
+        };
+        context_->service().post(task);
+        return;
+    }
+
     timer_.start(IDLE_WAITING_TIME, [self, this] (const boost::system::error_code&) {
         XERROR_WITH_ID(this) << "idle waiting timed out.";
         stop();
@@ -71,6 +91,64 @@ void client_connection::reset() {
     read();
 }
 
+bool client_connection::decode_next() {
+    if (pipelined_.empty())
+        return false;
+
+    decoder_->reset();
+    message_->reset();
+
+    std::string data;
+    data.swap(pipelined_);
+    decode(data.data(), data.size());
+    return true;
+}
+
+bool client_connection::decode_pipelined() {
+    if (pipelined_.empty())
+        return false;
+
+    if (!spare_decoder_) {
+        spare_decoder_.reset(codec::http::make_decoder(HTTP_REQUEST));
+        spare_request_ = new message::http::http_request;
+        spare_message_.reset(spare_request_);
+    }
+
+    spare_decoder_->reset();
+    spare_message_->reset();
+
+    auto consumed = spare_decoder_->decode(pipelined_.data(), pipelined_.size(), *spare_message_);
+    if (!spare_message_->completed()) {
+        XDEBUG_WITH_ID(this) << "pipelined request incomplete, "
+                             << pipelined_.size() << " bytes kept.";
+        return false;
+    }
+
+    decoder_.swap(spare_decoder_);
+    message_.swap(spare_message_);
+    std::swap(request_, spare_request_);
+
+    std::string data;
+    data.swap(pipelined_);
+    keep_pipelined(data.data() + consumed, data.size() - consumed);
+
+    deliver();
+    return true;
+}
+
+void client_connection::tunnel() {
+    // the bytes received after the request switching the protocol are
+    // relayed before any other
+    if (!pipelined_.empty()) {
+        auto data = memory::buffer_cache::local().acquire();
+        *data << pipelined_;
+        pipelined_.clear();
+        relay(std::move(data));
+    }
+
+    connection::tunnel();
+}
+
 void client_connection::on_connect(const boost::system::error_code&, boost::asio::ip::tcp::resolver::iterator) {
     ASSERT_EXEC_RETNONE(0, stop);
 }
@@ -100,12 +178,19 @@ void client_connection::on_read(const boost::system::error_code& e, const char *
         return;
     }
 
+    if (tunneled()) {
+        relay(length);
+        return;
+    }
+
     if (message_->completed()) {
         XERROR_WITH_ID(this) << "message already completed.";
         stop();
         return;
     }
 
+    idle_ = false;
+
     if (timer_.running())
         cancel_timer();
 
@@ -115,27 +200,54 @@ void client_connection::on_read(const boost::system::error_code& e, const char *
                              << "\n------ dump message end ------";
     }
 
+    decode(data, length);
+}
+
+void client_connection::decode(const char *data, std::size_t length) {
     auto consumed = decoder_->decode(data, length, *message_);
-    // ASSERT_EXEC_RETNONE(consumed == length, stop);
-    if (consumed != length) {
+    if (consumed != length && !message_->completed()) {
         XERROR_WITH_ID(this) << "consumed data length not match, consumed: "
                              << consumed << ", desired: " << length;
-        stop();
+        context_->reply_error(*this, codec::http::BAD_REQUEST);
         return;
     }
 
+    // the decoder stops at the end of the request, the bytes left are the
+    // requests pipelined by the client, they are kept in order and decoded
+    // one by one, each after the response of the previous one is written,
+    // so the responses are returned in sequence
+    keep_pipelined(data + consumed, length - consumed);
+
     if (!message_->deliverable()) {
         read();
         return;
     }
 
+    deliver();
+}
+
+void client_connection::keep_pipelined(const char *data, std::size_t length) {
+    if (length == 0)
+        return;
+
+    if (get_request().get_method() == "CONNECT") {
+        XWARN_WITH_ID(this) << "data after CONNECT request dropped: "
+                            << length << " bytes.";
+        return;
+    }
+
+    XDEBUG_WITH_ID(this) << "pipelined requests received: " << length << " bytes.";
+    pipelined_.assign(data, length);
+}
+
+void client_connection::deliver() {
     auto task = [this] () { context_->on_event(READ, *this); };
     context_->service().post(task);
 
     auto self(shared_from_this());
     timer_.start(SVR_RSP_WAITING_TIME, [self, this] (const boost::system::error_code&) {
         XERROR_WITH_ID(this) << "server response waiting timed out.";
-        stop();
+        context_->on_event(TIMEOUT, *this);
     });
 }
 
@@ -169,5 +281,17 @@ void client_connection::on_handshake(const boost::system::error_code& e) {
     context_->service().post(task);
 }
 
+void client_connection::on_drain() {
+    XDEBUG_WITH_ID(this) << "on_drain() called.";
+
+    if (stopped_) {
+        XERROR_WITH_ID(this) << "connection stopped.";
+        return;
+    }
+
+    auto task = [this] () { context_->on_event(DRAIN, *this); };
+    context_->service().post(task);
+}
+
 } // namespace net
 } // namespace x
@@ -8,14 +8,32 @@
 namespace x {
 namespace net {
 
+std::atomic<std::size_t> connection::read_calls_(0);
+std::atomic<std::size_t> connection::read_bytes_(0);
+
 connection::connection(context_ptr ctx, connection_manager& mgr)
     : connected_(false),
       stopped_(false),
+      idle_(false),
       socket_(new socket_wrapper(ctx->service())),
       timer_(ctx->service()),
       context_(ctx),
+      manager_(&mgr),
+      buffer_in_(nullptr),
+      buffer_in_capacity_(0),
+      buffer_read_(nullptr),
+      buffer_read_capacity_(0),
+      read_size_(READ_BUFFER_SIZE),
+      reading_(false),
       writing_(false),
-      manager_(&mgr) {}
+      drain_pending_(false),
+      tunneled_(false),
+      tunnel_activity_(0) {}
+
+connection::~connection() {
+    memory::buffer_pool::local().release(buffer_in_, buffer_in_capacity_);
+    XDEBUG_WITH_ID(this) << "connection destructed.";
+}
 
 void connection::read() {
     XDEBUG_WITH_ID(this) << "=> read()";
@@ -23,16 +41,29 @@ void connection::read() {
     ASSERT_EXEC_RETNONE(connected_, stop);
     ASSERT_EXEC_RETNONE(!stopped_, stop);
 
-    auto callback = std::bind(&connection::on_read,
-                              shared_from_this(),
-                              std::placeholders::_1,
-                              buffer_in_.data(),
-                              std::placeholders::_2);
-
-    boost::asio::async_read(*socket_,
-                            boost::asio::buffer(buffer_in_),
-                            boost::asio::transfer_at_least(1),
-                            callback);
+    // a read may be already in progress, e.g. when the requests pipelined
+    // are written one after another
+    if (reading_) {
+        XDEBUG_WITH_ID(this) << "<= read(), already reading.";
+        return;
+    }
+    reading_ = true;
+
+    // an idle connection may wait long for the next message, so it waits
+    // until the socket is readable, and borrows a buffer only after that;
+    // this is not done in SSL mode, as the data may be already buffered in
+    // the SSL stream, while the socket itself is not readable
+    if (idle_)
+        read_size_ = READ_BUFFER_SIZE;
+
+    if (idle_ && !socket_->ssl()) {
+        auto callback = std::bind(&connection::on_ready,
+                                  shared_from_this(),
+                                  std::placeholders::_1);
+        socket_->async_wait_readable(callback);
+    } else {
+        do_read();
+    }
 
     XDEBUG_WITH_ID(this) << "<= read()";
 }
@@ -58,20 +89,113 @@ void connection::write(const message::message& message) {
     if (timer_.running())
         cancel_timer();
 
-    memory::buffer_ptr buf(new memory::byte_buffer);
-    encoder_->encode(message, *buf);
-
+    auto buf = encode(message);
     if (buf->size() > 0)
-        buffer_out_.push_back(buf);
+        buffer_out_.push_back(std::move(buf));
+    else
+        memory::buffer_cache::local().recycle(std::move(buf));
 
     do_write();
 
     XDEBUG_WITH_ID(this) << "<= write(msg)";
 }
 
+void connection::write(memory::buffer_ptr buf) {
+    XDEBUG_WITH_ID(this) << "=> write(buf)";
+
+    ASSERT_EXEC_RETNONE(!stopped_, stop);
+
+    if (tunneled_)
+        ++tunnel_activity_;
+    else if (timer_.running())
+        cancel_timer();
+
+    if (buf->size() > 0)
+        buffer_out_.push_back(std::move(buf));
+
+    do_write();
+
+    XDEBUG_WITH_ID(this) << "<= write(buf)";
+}
+
+void connection::write(const char *data, std::size_t size) {
+    auto buf = memory::buffer_cache::local().acquire();
+    *buf << memory::byte_buffer::wrap(data, size);
+    write(std::move(buf));
+}
+
+memory::buffer_ptr connection::encode(const message::message& message) {
+    auto buf = memory::buffer_cache::local().acquire();
+    encoder_->encode(message, *buf);
+    return buf;
+}
+
 void connection::reset() {
-    buffer_out_.clear();
+    auto& cache = memory::buffer_cache::local();
+    while (!buffer_out_.empty())
+        cache.recycle(buffer_out_.pop_front());
     writing_ = false;
+    drain_pending_ = false;
+    idle_ = true;
+    read_size_ = READ_BUFFER_SIZE;
+}
+
+void connection::tunnel() {
+    XDEBUG_WITH_ID(this) << "switch to tunnel.";
+
+    tunneled_ = true;
+    idle_ = false;
+    watch_tunnel();
+    read();
+}
+
+void connection::relay(std::size_t length) {
+    ++tunnel_activity_;
+
+    // the timer may be still cancelling the response timer when the tunnel
+    // is set up, it is started by the first read then
+    if (!timer_.running())
+        watch_tunnel();
+
+    relay(take_read_buffer(length));
+}
+
+void connection::relay(memory::buffer_ptr data) {
+    auto task = [this, data] () { context_->on_tunnel_data(data, *this); };
+    context_->service().post(task);
+}
+
+void connection::watch_tunnel() {
+    auto self(shared_from_this());
+    auto activity = tunnel_activity_;
+    timer_.start(TUNNEL_IDLE_TIME, [self, this, activity] (const boost::system::error_code&) {
+        if (stopped_)
+            return;
+
+        if (tunnel_activity_ == activity) {
+            XDEBUG_WITH_ID(this) << "tunnel idle timed out.";
+            stop();
+            return;
+        }
+
+        watch_tunnel();
+    });
+}
+
+std::size_t connection::memory_usage() const {
+    std::size_t usage = sizeof(connection) + socket_->memory_usage() + buffer_in_capacity_;
+    buffer_out_.for_each([&usage] (const memory::byte_buffer& buf) {
+        usage += sizeof(memory::byte_buffer) + buf.capacity();
+    });
+    return usage;
+}
+
+bool connection::congested() {
+    if (buffer_out_.bytes() <= HIGH_WATERMARK)
+        return false;
+
+    drain_pending_ = true;
+    return true;
 }
 
 void connection::stop(bool notify) {
@@ -105,6 +229,66 @@ void connection::stop(bool notify) {
     stopped_ = true;
 }
 
+void connection::do_read() {
+    assert(!buffer_in_);
+
+    buffer_in_ = memory::buffer_pool::local().acquire(read_size_, buffer_in_capacity_);
+
+    auto callback = std::bind(static_cast<void(connection::*)(const boost::system::error_code&,
+                                                              std::size_t)>(&connection::on_read),
+                              shared_from_this(),
+                              std::placeholders::_1,
+                              std::placeholders::_2);
+
+    socket_->async_read_some(boost::asio::buffer(buffer_in_, buffer_in_capacity_), callback);
+}
+
+void connection::on_ready(const boost::system::error_code& e) {
+    // let on_read(...) handle the errors
+    if (e || stopped_) {
+        reading_ = false;
+        on_read(e, nullptr, 0);
+        return;
+    }
+
+    do_read();
+}
+
+void connection::on_read(const boost::system::error_code& e, std::size_t length) {
+    // take the buffer over, as on_read(...) may start another read
+    reading_ = false;
+    buffer_read_ = buffer_in_;
+    buffer_read_capacity_ = buffer_in_capacity_;
+    buffer_in_ = nullptr;
+    buffer_in_capacity_ = 0;
+
+    if (!e) {
+        ++read_calls_;
+        read_bytes_ += length;
+
+        // a full buffer means more data is probably waiting, read more at
+        // a time to reduce the read/decode cycles for bulk transfers
+        if (length == buffer_read_capacity_ && read_size_ < MAX_READ_BUFFER_SIZE)
+            read_size_ *= 2;
+    }
+
+    on_read(e, buffer_read_, length);
+
+    // the buffer may be taken over by take_read_buffer()
+    memory::buffer_pool::local().release(buffer_read_, buffer_read_capacity_);
+    buffer_read_ = nullptr;
+    buffer_read_capacity_ = 0;
+}
+
+memory::buffer_ptr connection::take_read_buffer(std::size_t size) {
+    assert(buffer_read_);
+
+    memory::buffer_ptr buf(new memory::byte_buffer(buffer_read_, buffer_read_capacity_, size));
+    buffer_read_ = nullptr;
+    buffer_read_capacity_ = 0;
+    return buf;
+}
+
 void connection::do_write() {
     if (writing_) return;
     if (buffer_out_.empty()) return;
@@ -117,20 +301,19 @@ void connection::do_write() {
 
     writing_ = true;
 
-    auto callback = std::bind(static_cast<void(connection::*)(const::boost::system::error_code&,
+    auto callback = std::bind(static_cast<void(connection::*)(const boost::system::error_code&,
                                                               std::size_t)>(&connection::on_write),
                               shared_from_this(),
                               std::placeholders::_1,
                               std::placeholders::_2);
 
-    auto& candidate = buffer_out_.front();
     if (x::log::debug_enabled()) {
         XDEBUG_WITH_ID(this) << "\n----- dump message begin -----\n"
-                             << std::string(candidate->data(), candidate->size())
+                             << std::string(buffer_out_.front_data(), buffer_out_.front_size())
                              << "\n------ dump message end ------";
     }
-    socket_->async_write_some(boost::asio::buffer(candidate->data(),
-                                                  candidate->size()),
+    socket_->async_write_some(boost::asio::buffer(buffer_out_.front_data(),
+                                                  buffer_out_.front_size()),
                               callback);
 
     XDEBUG_WITH_ID(this) << "<= do_write()";
@@ -146,15 +329,22 @@ void connection::on_write(const boost::system::error_code& e, std::size_t length
 
     CHECK_LOG_EXEC_RETURN(e, "write", stop);
 
-    auto it = buffer_out_.begin();
-    if (length < (*it)->size()) {
+    bool completed = buffer_out_.consume(length);
+    if (completed)
+        memory::buffer_cache::local().recycle(buffer_out_.pop_front());
+
+    if (drain_pending_ && buffer_out_.bytes() <= LOW_WATERMARK) {
+        XDEBUG_WITH_ID(this) << "write queue drained.";
+        drain_pending_ = false;
+        on_drain();
+    }
+
+    if (!completed) {
         XERROR_WITH_ID(this) << "write incomplete, continue.";
-        (*it)->erase(0, length);
         do_write();
         return;
     }
 
-    buffer_out_.erase(it);
     if (!buffer_out_.empty()) {
         XDEBUG_WITH_ID(this) << "more buffers added, continue.";
         do_write();
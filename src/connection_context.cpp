@@ -16,18 +16,56 @@ boost::asio::io_service& connection_context::service() const {
 
 void connection_context::reset() {
     message_exchange_completed_= false;
+    server_read_paused_ = false;
+    client_read_paused_ = false;
+    response_started_ = false;
+    pipeline_.clear();
+    request_deferred_ = false;
 }
 
 void connection_context::on_event(connection_event event, client_connection& conn) {
     switch (event) {
     case READ:
-        return on_client_message(conn.get_message());
+        return on_client_message(conn.get_request());
     case WRITE: {
+        if (close_client_) {
+            XDEBUG << "error response written, close client connection [id: " << conn.id() << "].";
+            conn.stop();
+            return;
+        }
+
         if (https_ && !ssl_setup_) {
             auto svr_conn(server_conn_.lock());
             assert(svr_conn);
+
+            // the root CA or DH parameters are still being generated, the
+            // handshake is deferred until they are ready
             auto& cert_mgr = server_.get_certificate_manager();
-            conn.handshake(cert_mgr.get_certificate(svr_conn->get_host()), cert_mgr.get_dh_parameters());
+            if (!cert_mgr.ready()) {
+                XDEBUG << "certificate manager not ready, defer handshake of client connection [id: "
+                       << conn.id() << "].";
+                auto self(shared_from_this());
+                auto client(conn.shared_from_this());
+                cert_mgr.when_ready([self, this, client] (bool ready) {
+                    if (client->stopped())
+                        return;
+                    if (!ready) {
+                        client->stop();
+                        return;
+                    }
+                    on_event(WRITE, static_cast<client_connection&>(*client));
+                });
+                return;
+            }
+
+            auto ctx = cert_mgr.get_context(svr_conn->get_host());
+            if (!ctx) {
+                XERROR << "no SSL context for host " << svr_conn->get_host()
+                       << ", close client connection [id: " << conn.id() << "].";
+                conn.stop();
+                return;
+            }
+            conn.handshake(ctx);
             return;
         }
 
@@ -51,6 +89,34 @@ void connection_context::on_event(connection_event event, client_connection& con
         conn.read();
         return;
     }
+    case DRAIN: {
+        if (!server_read_paused_)
+            return;
+
+        server_read_paused_ = false;
+        auto svr_conn(server_conn_.lock());
+        if (svr_conn && !svr_conn->stopped()) {
+            XDEBUG << "client connection [id: " << conn.id()
+                   << "] drained, resume reading server connection [id: " << svr_conn->id() << "].";
+            svr_conn->read();
+        }
+        return;
+    }
+    case TIMEOUT: {
+        // nothing is written to the client yet, otherwise the timer would be
+        // cancelled, so the client can still be told about the timeout,
+        // unless a response of the requests pipelined is being written
+        XERROR << "server response timed out, client connection [id: " << conn.id() << "].";
+        auto svr_conn(server_conn_.lock());
+        if (svr_conn && !svr_conn->stopped())
+            svr_conn->stop(false);
+        if (response_started_) {
+            conn.stop(false);
+            return;
+        }
+        reply_error(conn, codec::http::GATEWAY_TIMEOUT);
+        return;
+    }
     default:
         assert(0);
     }
@@ -60,7 +126,7 @@ void connection_context::on_event(connection_event event, server_connection& con
     switch (event) {
     case CONNECT: {
         if (https_) {
-            conn.handshake();
+            conn.handshake(server_.get_certificate_manager().get_client_context());
             return;
         }
 
@@ -68,11 +134,24 @@ void connection_context::on_event(connection_event event, server_connection& con
         return;
     }
     case READ:
-        return on_server_message(conn.get_message());
+        return on_server_message(conn.get_response());
     case HANDSHAKE: {
         conn.write();
         return;
     }
+    case DRAIN: {
+        if (!client_read_paused_)
+            return;
+
+        client_read_paused_ = false;
+        auto client_conn(client_conn_.lock());
+        if (client_conn && !client_conn->stopped()) {
+            XDEBUG << "server connection [id: " << conn.id()
+                   << "] drained, resume reading client connection [id: " << client_conn->id() << "].";
+            client_conn->read();
+        }
+        return;
+    }
     default:
         assert(0);
     }
@@ -90,21 +169,54 @@ void connection_context::on_stop(std::shared_ptr<connection> conn) {
         return;
     }
 
-    if (c)
-        c->stop(false);
+    if (!c || c->stopped())
+        return;
+
+    // the bytes relayed from the server are written before the client is
+    // closed
+    if (tunnel_ && c->pending_bytes() > 0) {
+        close_client_ = true;
+        return;
+    }
+
+    // the server failed before it responded, the requests pipelined are sent
+    // again on a new connection if possible, otherwise the client is told
+    // instead of just closing the connection
+    if (!response_started_ && !message_exchange_completed_) {
+        if (replay())
+            return;
+
+        reply_error(static_cast<client_connection&>(*c), codec::http::BAD_GATEWAY);
+        return;
+    }
+
+    c->stop(false);
 }
 
-void connection_context::on_client_message(message::message& msg) {
-    auto request = dynamic_cast<message::http::http_request *>(&msg);
-    assert(request);
-    assert(request->completed());
+void connection_context::reply_error(client_connection& conn, codec::http::canned_response_type type) {
+    auto response = codec::http::canned_response(type);
+    close_client_ = true;
+    conn.write(response.data(), response.size());
+}
+
+void connection_context::on_client_message(message::http::http_request& request) {
+    assert(request.completed());
 
     auto svr_conn(server_conn_.lock());
 
     // the server connection exists, it must not be the first request, we just
     // write the message to server
     if (svr_conn) {
-        svr_conn->write(msg);
+        // a request which is not idempotent is not pipelined, it waits until
+        // the responses of the requests in flight are completed
+        if (!pipeline_.accepts(request)) {
+            XDEBUG << "request deferred until the requests in flight are completed, client connection [id: "
+                   << client_conn_.lock()->id() << "].";
+            request_deferred_ = true;
+            return;
+        }
+
+        send_request(static_cast<server_connection&>(*svr_conn), request);
         return;
     }
 
@@ -113,50 +225,190 @@ void connection_context::on_client_message(message::message& msg) {
     //    is a CONNECT request
     // 2. the server connection timed out and closed, we still need to parse
     //    the host and port, under this condition, we do not need
+    auto client_conn(client_conn_.lock());
+    assert(client_conn);
+    auto& client = static_cast<client_connection&>(*client_conn);
+
     std::string host;
     unsigned short port;
     bool orig_https = https_;
-    parse_destination(*request, https_, host, port);
+    if (!parse_destination(request, https_, host, port)) {
+        XERROR << "no destination in request, client connection [id: " << client_conn->id() << "].";
+        reply_error(client, codec::http::BAD_REQUEST);
+        return;
+    }
     assert(!(orig_https && !https_));
 
-    svr_conn = std::make_shared<server_connection>(shared_from_this(),
-                                                   server_.get_server_connection_manager());
-    svr_conn->set_host(host);
-    svr_conn->set_port(port);
-    server_.get_server_connection_manager().add(svr_conn);
-    server_conn_ = svr_conn;
+    // the root CA or DH parameters can not be generated, HTTPS will never be
+    // available, the client is told to try later instead of being dropped
+    if (https_ && !ssl_setup_ && server_.get_certificate_manager().failed()) {
+        reply_error(client, codec::http::SERVICE_UNAVAILABLE);
+        return;
+    }
+
+    auto server_conn = connect_server(host, port);
 
-    auto client_conn(client_conn_.lock());
-    assert(client_conn);
     XDEBUG << "connection mapping: [id: " << client_conn->id()
-           << "] <=> [id: " << svr_conn->id() << "].";
+           << "] <=> [id: " << server_conn->id() << "].";
 
     if (https_ && !ssl_setup_) {
+        auto response = codec::http::canned_response(codec::http::CONNECTION_ESTABLISHED);
+        client_conn->write(response.data(), response.size());
+        return;
+    }
+
+    send_request(*server_conn, request);
+}
+
+void connection_context::on_server_message(message::http::http_response& response) {
+    auto client_conn(client_conn_.lock());
+    assert(client_conn);
+
+    // an interim response is forwarded as it is, the final one of the same
+    // request follows, maybe in the bytes already read
+    auto status = response.get_status();
+    if (status >= 100 && status < 200 && status != 101) {
+        auto server_conn(server_conn_.lock());
+        assert(server_conn);
+
+        XDEBUG << "interim response " << status << " forwarded from server connection [id: "
+               << server_conn->id() << "].";
+        client_conn->write(response);
+        client_conn->reset_encoder();
+        static_cast<server_connection&>(*server_conn).next_response();
+        return;
+    }
+
+    response_started_ = true;
+    client_conn->write(response);
+
+    // the body received so far is already encoded into the write queue
+    if (!response.completed())
+        response.discard_body();
+
+    if (response.get_status() == 101) {
+        start_tunnel();
+        return;
+    }
+
+    on_forwarded(response.completed());
+}
+
+void connection_context::on_server_body(memory::buffer_ptr body, server_connection& conn) {
+    auto client_conn(client_conn_.lock());
+    assert(client_conn);
+
+    client_conn->write(std::move(body));
+
+    on_forwarded(conn.get_response().completed());
+}
+
+void connection_context::on_tunnel_data(memory::buffer_ptr data, connection& conn) {
+    auto client_conn(client_conn_.lock());
+    auto server_conn(server_conn_.lock());
+    if (!client_conn || !server_conn)
+        return;
 
-        using namespace message::http;
-        auto response = http_response::make_response(http_response::SSL_REPLY);
-        client_conn->write(*response);
+    bool from_client = &conn == client_conn.get();
+    auto& peer = from_client ? *server_conn : *client_conn;
+    if (peer.stopped())
+        return;
+
+    peer.write(std::move(data));
+    if (conn.stopped())
+        return;
+
+    // the same as a response body, stop reading until the peer catches up
+    if (peer.congested()) {
+        XDEBUG << "connection [id: " << peer.id() << "] congested, pause reading tunnel connection [id: "
+               << conn.id() << "].";
+        (from_client ? client_read_paused_ : server_read_paused_) = true;
         return;
     }
 
-    svr_conn->write(msg);
+    conn.read();
 }
 
-void connection_context::on_server_message(message::message& msg) {
+void connection_context::on_forwarded(bool completed) {
     auto client_conn(client_conn_.lock());
     auto server_conn(server_conn_.lock());
     assert(client_conn);
     assert(server_conn);
 
-    client_conn->write(msg);
+    if (!completed) {
+        // stop reading the server until the client catches up, so that the
+        // data buffered is bounded by the watermarks, but not the speed gap
+        if (client_conn->congested()) {
+            XDEBUG << "client connection [id: " << client_conn->id()
+                   << "] congested, pause reading server connection [id: " << server_conn->id() << "].";
+            server_read_paused_ = true;
+            return;
+        }
 
-    if (!msg.completed()) {
         server_conn->read();
         return;
     }
 
+    // the responses of the requests pipelined are returned in order, the next
+    // one is waited for on the same connection, or on a new one, to which
+    // the requests left are sent again if the server closes the connection
+    if (!pipeline_.empty()) {
+        bool limited = pipeline_.full();
+        pipeline_.pop();
+
+        if (!pipeline_.empty() || request_deferred_) {
+            auto& client = static_cast<client_connection&>(*client_conn);
+            auto& server = static_cast<server_connection&>(*server_conn);
+            response_started_ = false;
+            client.reset_encoder();
+
+            if (!pipeline_.empty()) {
+                if (server.keep_alive()) {
+                    server.next_response();
+                    // no request is pipelined when the limit is reached, so
+                    // the next one is decoded now
+                    if (limited)
+                        pipeline_next(client);
+                    return;
+                }
+
+                XDEBUG << "response completed, close server connection [id: " << server.id()
+                       << "] with " << pipeline_.size() << " requests in flight.";
+                server.stop(false);
+                if (!replay())
+                    reply_error(client, codec::http::BAD_GATEWAY);
+                return;
+            }
+
+            // the same as below, the bytes after the response belong to no
+            // request, the deferred one is sent on a new connection
+            request_deferred_ = false;
+            if (server.has_pending())
+                XWARN << "unexpected data after response, close server connection [id: " << server.id() << "].";
+
+            if (server.keep_alive() && !server.has_pending()) {
+                server.reset();
+                send_request(server, client.get_request());
+            } else {
+                server.stop(false);
+                server_conn_.reset();
+                on_client_message(client.get_request());
+            }
+            return;
+        }
+    }
+
     message_exchange_completed_ = true;
 
+    // the bytes after the response do not belong to any request, so the
+    // connection can not be reused
+    auto& server = static_cast<server_connection&>(*server_conn);
+    if (server.has_pending()) {
+        XWARN << "unexpected data after response, close server connection [id: " << server.id() << "].";
+        server.stop(false);
+        return;
+    }
+
     if (server_conn->keep_alive()) {
         XDEBUG << "response completed, keep server connection [id: " << server_conn->id() << "] alive.";
         server_conn->reset();
@@ -166,24 +418,112 @@ void connection_context::on_server_message(message::message& msg) {
     }
 }
 
-void connection_context::parse_destination(const message::http::http_request &request,
+std::shared_ptr<server_connection> connection_context::connect_server(const std::string& host,
+                                                                     unsigned short port) {
+    auto svr_conn = std::make_shared<server_connection>(shared_from_this(),
+                                                        server_.get_server_connection_manager());
+    svr_conn->set_host(host);
+    svr_conn->set_port(port);
+    server_.get_server_connection_manager().add(svr_conn);
+    server_conn_ = svr_conn;
+    return svr_conn;
+}
+
+void connection_context::send_request(server_connection& conn, message::http::http_request& request) {
+    if (!server_.upstream_pipelining()) {
+        conn.write(request);
+        return;
+    }
+
+    // the request is encoded on its own and kept, the client connection may
+    // decode the next request into the same message right after
+    auto buf = conn.encode(request);
+    conn.reset_encoder();
+
+    pipeline_.push(buf, request_pipeline::idempotent(request));
+    conn.write(std::move(buf));
+
+    auto client_conn(client_conn_.lock());
+    assert(client_conn);
+    pipeline_next(static_cast<client_connection&>(*client_conn));
+}
+
+void connection_context::pipeline_next(client_connection& client) {
+    // the request deferred is still held by the client connection
+    if (request_deferred_ || !pipeline_.pipelinable(client.keep_alive()))
+        return;
+
+    if (client.decode_pipelined()) {
+        XDEBUG << "pipeline next request, client connection [id: " << client.id()
+               << "], requests in flight: " << pipeline_.size() << ".";
+    }
+}
+
+bool connection_context::replay() {
+    if (!pipeline_.replayable())
+        return false;
+
+    auto old_conn(server_conn_.lock());
+    assert(old_conn);
+    auto svr_conn = connect_server(old_conn->get_host(), old_conn->get_port());
+    server_read_paused_ = false;
+
+    XDEBUG << "send " << pipeline_.size() << " requests in flight again, server connection [id: "
+           << old_conn->id() << "] => [id: " << svr_conn->id() << "].";
+
+    svr_conn->write(pipeline_.replay());
+
+    return true;
+}
+
+void connection_context::start_tunnel() {
+    auto client_conn(client_conn_.lock());
+    auto server_conn(server_conn_.lock());
+    assert(client_conn);
+    assert(server_conn);
+
+    // a request switching the protocol is never followed by another one in
+    // flight, so this response is the last one
+    if (pipeline_.size() > 1) {
+        XERROR << "protocol switched with requests in flight, server connection [id: "
+               << server_conn->id() << "].";
+        server_conn->stop();
+        return;
+    }
+
+    XDEBUG << "protocol switched, tunnel: [id: " << client_conn->id()
+           << "] <=> [id: " << server_conn->id() << "].";
+
+    tunnel_ = true;
+    pipeline_.clear();
+    client_conn->tunnel();
+    server_conn->tunnel();
+}
+
+bool connection_context::parse_destination(const message::http::http_request &request,
                                            bool& https, std::string& host, unsigned short& port) {
-    auto method = request.get_method();
+    auto& method = request.get_method();
     if (method.length() == 7 && method[0] == 'C' && method[1] == 'O') {
         https = true;
         host = request.get_uri();
         port = 443;
     } else {
-        auto found = request.find_header("Host", host);
-        assert(found);
+        if (!request.find_header(message::http::HEADER_HOST, host))
+            return false;
         port = 80;
     }
 
     auto sep = host.find(':');
     if (sep != std::string::npos) {
-        port = boost::lexical_cast<unsigned short>(host.substr(sep + 1));
+        try {
+            port = boost::lexical_cast<unsigned short>(host.substr(sep + 1));
+        } catch (boost::bad_lexical_cast&) {
+            return false;
+        }
         host = host.substr(0, sep);
     }
+
+    return !host.empty();
 }
 
 } // namespace net
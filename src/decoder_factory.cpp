@@ -0,0 +1,51 @@
+#include "x/codec/http/decoder_factory.hpp"
+#include "x/codec/http/http_decoder.hpp"
+#include "x/codec/http/simd_http_decoder.hpp"
+#include "x/log/log.hpp"
+
+namespace x {
+namespace codec {
+namespace http {
+
+namespace {
+
+decoder_backend backend = HTTP_PARSER_BACKEND;
+std::size_t body_reserve_limit = DEFAULT_BODY_RESERVE_LIMIT;
+
+} // anonymous namespace
+
+bool set_decoder_backend(const std::string& name) {
+    if (name == "http-parser") {
+        backend = HTTP_PARSER_BACKEND;
+    } else if (name == "simd") {
+        backend = SIMD_BACKEND;
+        XINFO << "HTTP decoder: SIMD, instruction set: " << simd_http_decoder::instruction_set();
+    } else {
+        XERROR << "unknown HTTP decoder: " << name;
+        return false;
+    }
+
+    return true;
+}
+
+decoder_backend get_decoder_backend() {
+    return backend;
+}
+
+message_decoder *make_decoder(http_parser_type type) {
+    if (backend == SIMD_BACKEND)
+        return new simd_http_decoder(type);
+    return new http_decoder(type);
+}
+
+void set_body_reserve_limit(std::size_t limit) {
+    body_reserve_limit = limit;
+}
+
+std::size_t get_body_reserve_limit() {
+    return body_reserve_limit;
+}
+
+} // namespace http
+} // namespace codec
+} // namespace x
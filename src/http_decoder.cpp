@@ -1,3 +1,5 @@
+#include <climits>
+#include "x/codec/http/decoder_factory.hpp"
 #include "x/codec/http/http_decoder.hpp"
 #include "x/log/log.hpp"
 #include "x/message/http/http_message.hpp"
@@ -20,10 +22,13 @@ http_parser_settings http_decoder::settings_ = {
 };
 
 std::size_t http_decoder::decode(const char *begin, std::size_t length, message::message& msg) {
-    message_ = dynamic_cast<message::http::http_message *>(&msg);
-    assert(message_);
+    message_ = message::message_cast<message::http::http_message>(&msg);
 
-    auto consumed = ::http_parser_execute(&parser_, &settings_, begin, length);
+    raw_begin_ = in_headers_ ? begin : nullptr;
+    body_begin_ = chunked_ && !message_completed_ ? begin : nullptr;
+    auto consumed = execute(begin, length);
+    raw_begin_ = nullptr;
+    body_begin_ = nullptr;
 
     if (consumed != length) {
         if (HTTP_PARSER_ERRNO(&parser_) != HPE_OK) {
@@ -34,8 +39,9 @@ std::size_t http_decoder::decode(const char *begin, std::size_t length, message:
                    << "\n-----  error message dump end  -----";
             return 0;
         } else {
-            #warning TODO will this happen? a message is parsed, but there is still data?
-            XWARN << "Weird: parser does not consume all data, but there is no error.";
+            // the parsing stops at the end of a message, the rest is the next
+            // message, which is decoded by another call
+            assert(message_completed_);
             return consumed;
         }
     }
@@ -43,20 +49,110 @@ std::size_t http_decoder::decode(const char *begin, std::size_t length, message:
     return consumed;
 }
 
+std::size_t http_decoder::execute(const char *begin, std::size_t length) {
+    auto parsed = ::http_parser_execute(&parser_, &settings_, begin, length);
+
+    if (HTTP_PARSER_ERRNO(&parser_) == HPE_PAUSED) {
+        if (in_headers_) {
+            // the parser is paused in on_headers_complete(), begin[parsed] is
+            // the last LF of the headers, and the parsing should be resumed
+            // from it
+            assert(raw_begin_);
+            collect(begin + parsed, 1);
+            message_->get_headers().complete_raw();
+            in_headers_ = false;
+            raw_begin_ = nullptr;
+            if (chunked_)
+                body_begin_ = begin + parsed + 1;
+
+            ::http_parser_pause(&parser_, 0);
+            return parsed + execute(begin + parsed, length - parsed);
+        }
+
+        // the parser is paused in on_message_complete(), begin[parsed] is the
+        // first byte after the message, which belongs to the next message
+        assert(message_completed_);
+        if (body_begin_) {
+            message_->append_body(body_begin_, begin + parsed - body_begin_);
+            body_begin_ = nullptr;
+        }
+
+        ::http_parser_pause(&parser_, 0);
+        return parsed;
+    }
+
+    // the headers are not completed in this piece of data
+    if (in_headers_ && raw_begin_) {
+        collect(begin + parsed, 0);
+        raw_begin_ = nullptr;
+    }
+
+    // the chunked body is not completed in this piece of data
+    if (body_begin_) {
+        message_->append_body(body_begin_, begin + parsed - body_begin_);
+        body_begin_ = nullptr;
+    }
+
+    return parsed;
+}
+
+std::size_t http_decoder::collect(const char *at, std::size_t length) {
+    // copies the raw bytes up to the end of [at, at + length), and returns
+    // the offset of at in the raw headers
+    auto& headers = message_->get_headers();
+    auto offset = headers.raw_size() + (at - raw_begin_);
+    headers.append_raw(raw_begin_, at + length - raw_begin_);
+    raw_begin_ = at + length;
+    return offset;
+}
+
+void http_decoder::add_header() {
+    message_->get_headers().add_raw(field_offset_, field_end_ - field_offset_,
+                                    value_offset_, value_end_ - value_offset_);
+    field_offset_ = field_end_ = 0;
+    value_offset_ = value_end_ = 0;
+    value_seen_ = false;
+}
+
 bool http_decoder::keep_alive() const {
     if (!headers_completed_) // return false when headers are incomplete
         return false;
     return ::http_should_keep_alive(const_cast<http_parser*>(&parser_)) != 0;
 }
 
+std::size_t http_decoder::body_remaining() const {
+    // http-parser counts the body length down in content_length, which is
+    // ULLONG_MAX when there is no Content-Length
+    if (!headers_completed_ || message_completed_ || chunked_ ||
+        parser_.content_length == ULLONG_MAX)
+        return 0;
+    return static_cast<std::size_t>(parser_.content_length);
+}
+
+void http_decoder::skip_body(std::size_t length) {
+    assert(length <= body_remaining());
+
+    parser_.content_length -= length;
+    if (parser_.content_length > 0)
+        return;
+
+    // the parser is left in the body state, it is initialized again by reset()
+    message_completed_ = true;
+    message_->message_completed(true);
+}
+
 void http_decoder::reset() {
     ::http_parser_init(&parser_, static_cast<http_parser_type>(parser_.type));
     message_ = nullptr;
     headers_completed_ = false;
     message_completed_ = false;
     chunked_ = false;
-    current_header_field_.clear();
-    current_header_value_.clear();
+    in_headers_ = false;
+    raw_begin_ = nullptr;
+    field_offset_ = field_end_ = 0;
+    value_offset_ = value_end_ = 0;
+    value_seen_ = false;
+    body_begin_ = nullptr;
 }
 
 int http_decoder::on_message_begin(http_parser *parser) {
@@ -67,8 +163,9 @@ int http_decoder::on_message_begin(http_parser *parser) {
     p->headers_completed_ = false;
     p->message_completed_ = false;
     p->chunked_ = false;
-    p->current_header_field_.clear();
-    p->current_header_value_.clear();
+    p->field_offset_ = p->field_end_ = 0;
+    p->value_offset_ = p->value_end_ = 0;
+    p->value_seen_ = false;
     return 0;
 }
 
@@ -78,36 +175,40 @@ int http_decoder::on_url(http_parser *parser, const char *at, std::size_t length
     assert(p->message_);
 
     auto method = ::http_method_str(static_cast<http_method>(parser->method));
-    auto request = dynamic_cast<message::http::http_request *>(p->message_);
-    assert(request);
+    auto request = message::message_cast<message::http::http_request>(p->message_);
 
     request->set_method(std::string(method));
 
+    if (parser->method != HTTP_CONNECT)
+        request->set_uri(origin_form(at, length));
+    else
+        request->set_uri(std::string(at, length));
+    return 0;
+}
+
+std::string http_decoder::origin_form(const char *at, std::size_t length) {
     // Note: a request sent proxy contains the first line as below:
     //       => GET http://example.com/some/resource HTTP/1.1
     // so, we should convert it into the following before sending it
     // to server:
     //       => GET /some/resource HTTP/1.1
     std::string uri(at, length);
-    if (parser->method != HTTP_CONNECT) {
-        if (uri[0] != '/') {
-            const static std::string http("http://");
-            auto end = std::string::npos;
-            if(uri.compare(0, http.length(), http) != 0)
-                end = uri.find('/');
-            else
-                end = uri.find('/', http.length());
-
-            if(end == std::string::npos) {
-                uri = '/';
-            } else {
-                uri.erase(0, end);
-            }
+    if (uri[0] != '/') {
+        const static std::string http("http://");
+        auto end = std::string::npos;
+        if(uri.compare(0, http.length(), http) != 0)
+            end = uri.find('/');
+        else
+            end = uri.find('/', http.length());
+
+        if(end == std::string::npos) {
+            uri = '/';
+        } else {
+            uri.erase(0, end);
         }
     }
 
-    request->set_uri(uri);
-    return 0;
+    return uri;
 }
 
 int http_decoder::on_status(http_parser *parser, const char *at, std::size_t length) {
@@ -115,8 +216,7 @@ int http_decoder::on_status(http_parser *parser, const char *at, std::size_t len
     assert(p);
     assert(p->message_);
 
-    auto response = dynamic_cast<message::http::http_response *>(p->message_);
-    assert(response);
+    auto response = message::message_cast<message::http::http_response>(p->message_);
 
     response->set_status(p->parser_.status_code);
     response->set_message(std::string(at, length));
@@ -129,12 +229,24 @@ int http_decoder::on_header_field(http_parser *parser, const char *at, std::size
     assert(p);
     assert(p->message_);
 
-    if (!p->current_header_value_.empty()) {
-        p->message_->add_header(p->current_header_field_, p->current_header_value_);
-        p->current_header_field_.clear();
-        p->current_header_value_.clear();
+    // the trailers of a chunked body are forwarded with the body
+    if (p->headers_completed_)
+        return 0;
+
+    if (!p->in_headers_) {
+        p->in_headers_ = true;
+        p->raw_begin_ = at;
     }
-    p->current_header_field_.append(at, length);
+
+    if (p->value_seen_)
+        p->add_header();
+
+    // a field split into pieces by reads is still continuous in the raw
+    // headers, only its end moves
+    auto offset = p->collect(at, length);
+    if (p->field_end_ == p->field_offset_)
+        p->field_offset_ = offset;
+    p->field_end_ = offset + length;
     return 0;
 }
 
@@ -143,7 +255,15 @@ int http_decoder::on_header_value(http_parser *parser, const char *at, std::size
     assert(p);
     assert(p->message_);
 
-    p->current_header_value_.append(at, length);
+    if (p->headers_completed_)
+        return 0;
+
+    auto offset = p->collect(at, length);
+    if (!p->value_seen_) {
+        p->value_seen_ = true;
+        p->value_offset_ = offset;
+    }
+    p->value_end_ = offset + length;
     return 0;
 }
 
@@ -152,15 +272,11 @@ int http_decoder::on_headers_complete(http_parser *parser) {
     assert(p);
     assert(p->message_);
 
-    // current_header_value_ MUST NOT be empty
-    assert(!p->current_header_value_.empty());
-
     p->message_->set_major_version(parser->http_major);
     p->message_->set_minor_version(parser->http_minor);
 
-    p->message_->add_header(p->current_header_field_, p->current_header_value_);
-    p->current_header_field_.clear();
-    p->current_header_value_.clear();
+    if (p->field_end_ > p->field_offset_)
+        p->add_header();
 
     p->headers_completed_ = true;
     p->message_->headers_completed(true);
@@ -168,6 +284,15 @@ int http_decoder::on_headers_complete(http_parser *parser) {
     if (p->parser_.flags & F_CHUNKED)
         p->chunked_ = true;
 
+    if (!p->chunked_ && parser->content_length != ULLONG_MAX &&
+        parser->content_length <= get_body_reserve_limit())
+        p->message_->reserve_body(static_cast<std::size_t>(parser->content_length));
+
+    // pause the parser to find out where the headers end, as the position is
+    // not available in this callback
+    if (p->in_headers_)
+        ::http_parser_pause(parser, 1);
+
     return 0;
 }
 
@@ -176,17 +301,9 @@ int http_decoder::on_body(http_parser *parser, const char *at, std::size_t lengt
     assert(p);
     assert(p->message_);
 
-    if (p->chunked_) {
-        std::ostringstream out;
-        out << std::hex << length;
-        out.copyfmt(std::ios(nullptr));
-        out << CRLF;
-        p->message_->append_body(out.str());
-    }
-    p->message_->append_body(at, length);
-    if (p->chunked_) {
-        p->message_->append_body(CRLF, 2);
-    }
+    // a chunked body is appended in execute() with its framing
+    if (!p->chunked_)
+        p->message_->append_body(at, length);
 
     return 0;
 }
@@ -196,13 +313,13 @@ int http_decoder::on_message_complete(http_parser *parser) {
     assert(p);
     assert(p->message_);
 
-    if (p->chunked_) {
-        p->message_->append_body(END_CHUNK, 5);
-    }
-
     p->message_completed_ = true;
     p->message_->message_completed(true);
 
+    // pause the parser to find out where the message ends, so that the data
+    // after it is left to the next message
+    ::http_parser_pause(parser, 1);
+
     return 0;
 }
 
@@ -1,5 +1,4 @@
-#include <map>
-#include <string>
+#include <cstring>
 #include "x/codec/http/http_encoder.hpp"
 #include "x/common.hpp"
 #include "x/memory/byte_buffer.hpp"
@@ -7,14 +6,31 @@
 #include "x/message/http/http_message.hpp"
 #include "x/message/http/http_request.hpp"
 #include "x/message/http/http_response.hpp"
+#include "x/util/itoa.hpp"
 
 namespace x {
 namespace codec {
 namespace http {
 
+namespace {
+
+inline char *put(char *p, const char *data, std::size_t size) {
+    std::memcpy(p, data, size);
+    return p + size;
+}
+
+inline char *put(char *p, const std::string& str) {
+    return put(p, str.data(), str.size());
+}
+
+inline char *put(char *p, message::http::http_headers::string_ref str) {
+    return put(p, str.data(), str.size());
+}
+
+} // anonymous namespace
+
 std::size_t http_encoder::encode(const message::message& msg, memory::byte_buffer& buf) {
-    auto message = dynamic_cast<const message::http::http_message *>(&msg);
-    assert(message);
+    auto message = message::message_cast<const message::http::http_message>(&msg);
 
     // we do not do encoding if the headers are not completed
     if (!message->headers_completed())
@@ -22,6 +38,10 @@ std::size_t http_encoder::encode(const message::message& msg, memory::byte_buffe
 
     switch (state_) {
     case BEGIN: {
+        // the size of the whole output is known here, so the buffer is grown
+        // at most once, and each piece is copied in place
+        buf.reserve(buf.size() + first_line_size(*message) +
+                    headers_size(*message) + body_size(*message));
         auto line_length = encode_first_line(*message, buf);
         auto headers_length = encode_headers(*message, buf);
         auto body_length= encode_body(*message, buf);
@@ -52,66 +72,78 @@ std::size_t http_encoder::encode_first_line(const message::http::http_message& m
     assert(msg.headers_completed());
     assert(state_ == BEGIN);
 
-    std::string first_line;
+    auto size = first_line_size(msg);
+    auto p = buf.grow(size);
 
-#warning use byte_buffer below instead of std::string
     if (type_ == HTTP_REQUEST) {
-        auto request = dynamic_cast<const message::http::http_request *>(&msg);
-        assert(request);
-
-        first_line.append(request->get_method())
-                .append(1, ' ')
-                .append(request->get_uri())
-                .append(1, ' ')
-                .append("HTTP/")
-                .append(std::to_string(request->get_major_version()))
-                .append(1, '.')
-                .append(std::to_string(request->get_minor_version()))
-                .append(CRLF);
+        auto request = message::message_cast<const message::http::http_request>(&msg);
+
+        p = put(p, request->get_method());
+        *p++ = ' ';
+        p = put(p, request->get_uri());
+        p = put(p, " HTTP/", 6);
+        p += util::itoa(request->get_major_version(), p);
+        *p++ = '.';
+        p += util::itoa(request->get_minor_version(), p);
     } else {
-        auto response = dynamic_cast<const message::http::http_response *>(&msg);
-        assert(response);
-
-        first_line.append("HTTP/")
-                .append(std::to_string(response->get_major_version()))
-                .append(1, '.')
-                .append(std::to_string(response->get_minor_version()))
-                .append(1, ' ')
-                .append(std::to_string(response->get_status()))
-                .append(1, ' ')
-                .append(response->get_message())
-                .append(CRLF);
+        auto response = message::message_cast<const message::http::http_response>(&msg);
+
+        p = put(p, "HTTP/", 5);
+        p += util::itoa(response->get_major_version(), p);
+        *p++ = '.';
+        p += util::itoa(response->get_minor_version(), p);
+        *p++ = ' ';
+        p += util::itoa(response->get_status(), p);
+        *p++ = ' ';
+        p = put(p, response->get_message());
     }
-
-    buf << first_line;
+    p = put(p, CRLF, 2);
+    assert(p == buf.data() + buf.size());
 
     state_ = FIRST_LINE;
-    return first_line.length();
+    return size;
 }
 
 std::size_t http_encoder::encode_headers(const message::http::http_message& msg, memory::byte_buffer& buf) {
     assert(msg.headers_completed());
     assert(state_ == FIRST_LINE);
 
-    auto orig_size = buf.size();
+    auto size = headers_size(msg);
+    auto p = buf.grow(size);
+
+    // fast path, forward the headers as they are received
+    auto raw_headers = msg.get_raw_headers();
+    if (!raw_headers.empty()) {
+        put(p, raw_headers);
+        state_ = HEADERS;
+        return size;
+    }
 
     auto& headers = msg.get_headers();
-    for (auto it = std::begin(headers); it != std::end(headers); ++it) {
-        buf << it->first << ": " << it->second << CRLF;
+    for (std::size_t i = 0; i < headers.size(); ++i) {
+        p = put(p, headers.name(i));
+        p = put(p, ": ", 2);
+        p = put(p, headers.value(i));
+        p = put(p, CRLF, 2);
     }
-    buf << CRLF;
+    p = put(p, CRLF, 2);
+    assert(p == buf.data() + buf.size());
 
     state_ = HEADERS;
-    return buf.size() - orig_size;
+    return size;
 }
 
 std::size_t http_encoder::encode_body(const message::http::http_message& msg, memory::byte_buffer& buf) {
     assert(msg.headers_completed());
     assert(state_ == HEADERS || state_ == BODY);
 
+    // body_encoded_ is the offset in the whole body, while the body data
+    // before get_body_offset() may be already discarded
     auto& body = msg.get_body();
-    auto inc = body.size() - body_encoded_;
-    buf << memory::byte_buffer::wrap(body.data(body_encoded_), inc);
+    assert(body_encoded_ >= msg.get_body_offset());
+    auto pos = body_encoded_ - msg.get_body_offset();
+    auto inc = body.size() - pos;
+    buf << memory::byte_buffer::wrap(body.data() + pos, inc);
     body_encoded_ += inc;
 
     if (msg.completed())
@@ -122,6 +154,39 @@ std::size_t http_encoder::encode_body(const message::http::http_message& msg, me
     return inc;
 }
 
+std::size_t http_encoder::first_line_size(const message::http::http_message& msg) const {
+    // "HTTP/x.y", the two spaces and CRLF
+    auto size = 5 + util::digits10(msg.get_major_version()) + 1 +
+                util::digits10(msg.get_minor_version()) + 2 + 2;
+
+    if (type_ == HTTP_REQUEST) {
+        auto request = message::message_cast<const message::http::http_request>(&msg);
+        size += request->get_method().size() + request->get_uri().size();
+    } else {
+        auto response = message::message_cast<const message::http::http_response>(&msg);
+        size += util::digits10(response->get_status()) + response->get_message().size();
+    }
+
+    return size;
+}
+
+std::size_t http_encoder::headers_size(const message::http::http_message& msg) const {
+    auto raw_headers = msg.get_raw_headers();
+    if (!raw_headers.empty())
+        return raw_headers.size();
+
+    // each header is "name: value" and CRLF, then the empty line
+    auto& headers = msg.get_headers();
+    std::size_t size = 2;
+    for (std::size_t i = 0; i < headers.size(); ++i)
+        size += headers.name(i).size() + headers.value(i).size() + 4;
+    return size;
+}
+
+std::size_t http_encoder::body_size(const message::http::http_message& msg) const {
+    return msg.get_body().size() - (body_encoded_ - msg.get_body_offset());
+}
+
 void http_encoder::reset() {
     state_ = BEGIN;
     body_encoded_ = 0;
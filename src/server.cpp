@@ -1,3 +1,4 @@
+#include "x/codec/http/decoder_factory.hpp"
 #include "x/conf/config.hpp"
 #include "x/log/log.hpp"
 #include "x/net/client_connection.hpp"
@@ -10,8 +11,11 @@ namespace x {
 namespace net {
 
 server::server()
-    : signals_(service_),
+    : stats_interval_(0),
+      upstream_pipelining_(false),
+      signals_(service_),
       acceptor_(service_),
+      stats_timer_(service_),
       config_(new x::conf::config),
       cert_manager_(new x::ssl::certificate_manager),
       client_conn_mgr_(new x::net::connection_manager),
@@ -23,22 +27,60 @@ bool server::init() {
         return false;
     }
 
+    std::string san_mode;
+    if (config_->get_config("ssl.san_mode", san_mode) && san_mode == "domain") {
+        std::size_t san_max_names;
+        if (!config_->get_config("ssl.san_max_names", san_max_names))
+            san_max_names = x::ssl::certificate_manager::DEFAULT_SAN_MAX_NAMES;
+        cert_manager_->set_san_mode(x::ssl::certificate_manager::SAN_DOMAIN, san_max_names);
+    }
+
+    bool release_buffers;
+    if (!config_->get_config("ssl.release_buffers", release_buffers))
+        release_buffers = true;
+    cert_manager_->set_release_buffers(release_buffers);
+
     if (!cert_manager_->init()) {
         XFATAL << "unable to init certificate manager.";
         return false;
     }
 
+    std::string decoder;
+    if (config_->get_config("http.decoder", decoder) &&
+        !x::codec::http::set_decoder_backend(decoder))
+        return false;
+
+    std::size_t body_reserve_limit;
+    if (!config_->get_config("http.body_reserve_limit", body_reserve_limit))
+        body_reserve_limit = x::codec::http::DEFAULT_BODY_RESERVE_LIMIT;
+    x::codec::http::set_body_reserve_limit(body_reserve_limit);
+
+    if (!config_->get_config("http.upstream_pipelining", upstream_pipelining_))
+        upstream_pipelining_ = false;
+
     if (!config_->get_config("basic.port", port_))
         port_ = DEFAULT_SERVER_PORT;
 
+    if (!config_->get_config("basic.stats_interval", stats_interval_))
+        stats_interval_ = 0;
+
     init_signal_handler();
     init_acceptor();
 
+    // the listener is ready now, the root CA and DH parameters are generated
+    // if needed, and the certificates are loaded in background, plain HTTP
+    // requests are served in the meantime
+    std::size_t warmup_count;
+    if (!config_->get_config("ssl.warmup_count", warmup_count))
+        warmup_count = DEFAULT_WARMUP_COUNT;
+    cert_manager_->start(service_, warmup_count);
+
     return true;
 }
 
 void server::start() {
     start_accept();
+    start_stats_timer();
     service_.run();
 }
 
@@ -49,6 +91,8 @@ void server::init_signal_handler() {
     // signals_.add(SIGQUIT);
     signals_.async_wait([this] (const boost::system::error_code&, int) {
         XINFO << "stopping xProxy...";
+        cert_manager_->save_usage();
+        stats_timer_.cancel();
         client_conn_mgr_->stop_all();
         server_conn_mgr_->stop_all();
         acceptor_.close();
@@ -95,5 +139,52 @@ void server::start_accept() {
     });
 }
 
+void server::start_stats_timer() {
+    if (stats_interval_ <= 0)
+        return;
+
+    stats_timer_.expires_from_now(boost::posix_time::seconds(stats_interval_));
+    stats_timer_.async_wait([this] (const boost::system::error_code& e) {
+        if (e)
+            return;
+
+        report_stats();
+        start_stats_timer();
+    });
+}
+
+void server::report_stats() {
+    std::size_t total = 0, idle = 0, idle_ssl = 0, idle_ssl_bytes = 0;
+
+    auto count = [&] (const connection_manager& mgr) {
+        auto& connections = mgr.connections();
+        for (auto it = connections.begin(); it != connections.end(); ++it) {
+            ++total;
+            if (!(*it)->idle())
+                continue;
+
+            ++idle;
+            if ((*it)->ssl()) {
+                ++idle_ssl;
+                idle_ssl_bytes += (*it)->memory_usage();
+            }
+        }
+    };
+
+    count(*client_conn_mgr_);
+    count(*server_conn_mgr_);
+
+    XINFO << "connections: " << total << ", idle: " << idle
+          << ", idle TLS: " << idle_ssl
+          << ", bytes per idle TLS connection: "
+          << (idle_ssl > 0 ? idle_ssl_bytes / idle_ssl : 0)
+          << " (OpenSSL buffers " << (cert_manager_->release_buffers() ? "released" : "kept")
+          << " when idle)";
+
+    auto calls = connection::read_calls();
+    XINFO << "reads: " << calls << ", bytes read: " << connection::read_bytes()
+          << ", bytes per read: " << (calls > 0 ? connection::read_bytes() / calls : 0);
+}
+
 } // namespace net
 } // namespace x
@@ -1,4 +1,4 @@
-#include "x/codec/http/http_decoder.hpp"
+#include "x/codec/http/decoder_factory.hpp"
 #include "x/codec/http/http_encoder.hpp"
 #include "x/message/http/http_response.hpp"
 #include "x/net/connection_manager.hpp"
@@ -14,22 +14,32 @@ enum {
 
 server_connection::server_connection(context_ptr ctx, connection_manager& mgr)
     : connection(ctx, mgr),
-      resolver_(ctx->service()) {
-    decoder_.reset(new codec::http::http_decoder(HTTP_RESPONSE));
+      resolver_(ctx->service()),
+      started_(false) {
+    decoder_.reset(codec::http::make_decoder(HTTP_RESPONSE));
     encoder_.reset(new codec::http::http_encoder(HTTP_REQUEST));
-    message_.reset(new message::http::http_response);
+    response_ = new message::http::http_response;
+    message_.reset(response_);
     XDEBUG_WITH_ID(this) << "new server connection";
 }
 
+message::http::http_response& server_connection::get_response() {
+    return *response_;
+}
+
 bool server_connection::keep_alive() {
-    codec::message_decoder *decoder = decoder_.get();
-    return dynamic_cast<codec::http::http_decoder *>(decoder)->keep_alive();
+    return decoder_->keep_alive();
 }
 
 void server_connection::start() {
     assert(host_.length() > 0);
     assert(port_ != 0);
 
+    // the requests pipelined may be written before the connection is made
+    if (started_)
+        return;
+    started_ = true;
+
     auto self(shared_from_this());
     context_->set_server_connection(self);
 
@@ -50,14 +60,14 @@ void server_connection::connect() {
     XDEBUG_WITH_ID(this) << "<= connect()";
 }
 
-void server_connection::handshake(ssl::certificate ca, DH *dh) {
+void server_connection::handshake(ssl::ssl_context_ptr ctx) {
     XDEBUG_WITH_ID(this) << "=> handshake()";
 
     auto callback = std::bind(&connection::on_handshake,
                               shared_from_this(),
                               std::placeholders::_1);
 
-    socket_->switch_to_ssl(boost::asio::ssl::stream_base::client, ca, dh);
+    socket_->switch_to_ssl(boost::asio::ssl::stream_base::client, ctx);
     socket_->async_handshake(callback);
 
     XDEBUG_WITH_ID(this) << "<= handshake()";
@@ -72,6 +82,7 @@ void server_connection::reset() {
     decoder_->reset();
     encoder_->reset();
     message_->reset();
+    pending_.clear();
 
     auto self(shared_from_this());
     timer_.start(IDLE_WAITING_TIME, [self, this] (const boost::system::error_code&) {
@@ -80,6 +91,35 @@ void server_connection::reset() {
     });
 }
 
+void server_connection::next_response() {
+    XDEBUG_WITH_ID(this) << "waiting for next response...";
+
+    decoder_->reset();
+    message_->reset();
+
+    if (pending_.empty()) {
+        read();
+        return;
+    }
+
+    std::string data;
+    data.swap(pending_);
+    decode(data.data(), data.size());
+}
+
+void server_connection::tunnel() {
+    // the bytes read after the response switching the protocol are relayed
+    // before any other
+    if (!pending_.empty()) {
+        auto data = memory::buffer_cache::local().acquire();
+        *data << pending_;
+        pending_.clear();
+        relay(std::move(data));
+    }
+
+    connection::tunnel();
+}
+
 void server_connection::on_connect(const boost::system::error_code& e, boost::asio::ip::tcp::resolver::iterator) {
     XDEBUG_WITH_ID(this) << "on_connect() called.";
 
@@ -122,12 +162,15 @@ void server_connection::on_read(const boost::system::error_code& e, const char *
         return;
     }
 
-    if (message_->completed()) {
-        XERROR_WITH_ID(this) << "message already completed.";
-        stop();
+    if (tunneled()) {
+        relay(length);
+        if (!connected_)
+            stop();
         return;
     }
 
+    idle_ = false;
+
     if (timer_.running())
         cancel_timer();
 
@@ -137,16 +180,28 @@ void server_connection::on_read(const boost::system::error_code& e, const char *
                              << "\n------ dump message end ------";
     }
 
-    auto consumed = decoder_->decode(data, length, *message_);
-    ASSERT_EXEC_RETNONE(consumed == length, stop);
+    // the responses of the requests pipelined may arrive before the last
+    // one is handled, they are kept until next_response() is called
+    if (message_->completed()) {
+        XDEBUG_WITH_ID(this) << "message already completed, keep "
+                             << length << " bytes read.";
+        pending_.append(data, length);
+        return;
+    }
 
-    if (!message_->deliverable()) {
-        read();
+    // the rest of a body of a known length is passed through to the client
+    // as it is read, without being decoded or copied, unless the data goes
+    // beyond the body
+    auto remaining = decoder_->body_remaining();
+    if (remaining > 0 && length <= remaining) {
+        decoder_->skip_body(length);
+        auto body = take_read_buffer(length);
+        auto task = [this, body] () { context_->on_server_body(body, *this); };
+        context_->service().post(task);
         return;
     }
 
-    auto task = [this] () { context_->on_event(READ, *this); };
-    context_->service().post(task);
+    decode(data, length);
 }
 
 void server_connection::on_write() {
@@ -174,6 +229,36 @@ void server_connection::on_handshake(const boost::system::error_code& e) {
     context_->service().post(task);
 }
 
+void server_connection::decode(const char *data, std::size_t length) {
+    auto consumed = decoder_->decode(data, length, *message_);
+    if (consumed != length) {
+        // the decoder stops at the end of the response, the bytes left belong
+        // to the responses of the requests pipelined
+        ASSERT_EXEC_RETNONE(message_->completed(), stop);
+        pending_.assign(data + consumed, length - consumed);
+    }
+
+    if (!message_->deliverable()) {
+        read();
+        return;
+    }
+
+    auto task = [this] () { context_->on_event(READ, *this); };
+    context_->service().post(task);
+}
+
+void server_connection::on_drain() {
+    XDEBUG_WITH_ID(this) << "on_drain() called.";
+
+    if (stopped_) {
+        XERROR_WITH_ID(this) << "connection stopped.";
+        return;
+    }
+
+    auto task = [this] () { context_->on_event(DRAIN, *this); };
+    context_->service().post(task);
+}
+
 void server_connection::on_resolve(const boost::system::error_code& e, boost::asio::ip::tcp::resolver::iterator it) {
     XDEBUG_WITH_ID(this) << "on_resolve() called.";
 
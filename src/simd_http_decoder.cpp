@@ -0,0 +1,563 @@
+#include <cstring>
+#include <limits>
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSE4_2__))
+#include <immintrin.h>
+#endif
+#include "x/codec/http/decoder_factory.hpp"
+#include "x/codec/http/http_decoder.hpp"
+#include "x/codec/http/simd_http_decoder.hpp"
+#include "x/log/log.hpp"
+#include "x/message/http/http_message.hpp"
+#include "x/message/http/http_request.hpp"
+#include "x/message/http/http_response.hpp"
+
+namespace x {
+namespace codec {
+namespace http {
+
+namespace {
+
+const std::size_t npos = static_cast<std::size_t>(-1);
+
+/*
+ * Finds the first byte in [p, end) which is c1 or c2, returns end if there is
+ * no such byte.
+ */
+inline const char *find_any(const char *p, const char *end, char c1, char c2) {
+#if defined(__GNUC__) && defined(__AVX2__)
+    const __m256i v1 = _mm256_set1_epi8(c1);
+    const __m256i v2 = _mm256_set1_epi8(c2);
+    while (end - p >= 32) {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i eq = _mm256_or_si256(_mm256_cmpeq_epi8(data, v1), _mm256_cmpeq_epi8(data, v2));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(eq));
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+#elif defined(__GNUC__) && defined(__SSE4_2__)
+    const __m128i set = _mm_setr_epi8(c1, c2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    while (end - p >= 16) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int i = _mm_cmpestri(set, 2, data, 16,
+                             _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (i < 16)
+            return p + i;
+        p += 16;
+    }
+#endif
+
+    for (; p < end; ++p) {
+        if (*p == c1 || *p == c2)
+            return p;
+    }
+    return end;
+}
+
+/*
+ * Returns the index of the LF which ends the head, i.e. the LF of the empty
+ * line, only the LFs at or after from are checked.
+ */
+std::size_t find_head_end(const char *data, std::size_t from, std::size_t size) {
+    auto end = data + size;
+    for (auto p = find_any(data + from, end, LF, LF); p != end; p = find_any(p + 1, end, LF, LF)) {
+        std::size_t i = p - data;
+        if ((i >= 1 && data[i - 1] == LF) ||
+            (i >= 2 && data[i - 1] == CR && data[i - 2] == LF))
+            return i;
+    }
+    return npos;
+}
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/*
+ * Calls f(token) for each comma separated token in the value, the tokens
+ * are trimmed.
+ */
+template<typename Function>
+void for_each_token(boost::string_ref value, Function f) {
+    auto p = value.data();
+    auto end = p + value.size();
+    while (p < end) {
+        auto comma = find_any(p, end, ',', ',');
+        auto b = p, e = comma;
+        while (b < e && is_space(*b)) ++b;
+        while (e > b && is_space(e[-1])) --e;
+        if (b < e)
+            f(boost::string_ref(b, e - b));
+        p = comma == end ? end : comma + 1;
+    }
+}
+
+} // anonymous namespace
+
+std::size_t simd_http_decoder::decode(const char *begin, std::size_t length, message::message& msg) {
+    message_ = message::message_cast<message::http::http_message>(&msg);
+
+    auto p = begin;
+    auto end = begin + length;
+
+    if (state_ == HEAD) {
+        p += decode_head(p, end);
+        if (state_ == INVALID)
+            return 0;
+    }
+
+    if (state_ != HEAD && state_ != DONE) {
+        p += decode_body(p, end);
+        if (state_ == INVALID)
+            return 0;
+    }
+
+    // the data after the message is left to the next message
+    return p - begin;
+}
+
+void simd_http_decoder::reset() {
+    message_ = nullptr;
+    state_ = HEAD;
+    headers_completed_ = false;
+    message_completed_ = false;
+    head_.clear();
+    major_version_ = 0;
+    minor_version_ = 0;
+    status_ = 0;
+    chunked_ = false;
+    content_length_set_ = false;
+    connection_close_ = false;
+    connection_keep_alive_ = false;
+    remaining_ = 0;
+    chunk_size_seen_ = false;
+    trailer_line_empty_ = true;
+}
+
+bool simd_http_decoder::keep_alive() const {
+    if (!headers_completed_)
+        return false;
+
+    // the same rules as http_should_keep_alive() of http-parser
+    if (major_version_ > 0 && minor_version_ > 0) {
+        if (connection_close_)
+            return false;
+    } else if (!connection_keep_alive_) {
+        return false;
+    }
+
+    return state_ != BODY_EOF;
+}
+
+std::size_t simd_http_decoder::body_remaining() const {
+    return state_ == BODY_IDENTITY ? remaining_ : 0;
+}
+
+void simd_http_decoder::skip_body(std::size_t length) {
+    assert(length <= body_remaining());
+
+    remaining_ -= length;
+    if (remaining_ == 0)
+        complete();
+}
+
+const char *simd_http_decoder::instruction_set() {
+#if defined(__GNUC__) && defined(__AVX2__)
+    return "AVX2";
+#elif defined(__GNUC__) && defined(__SSE4_2__)
+    return "SSE4.2";
+#else
+    return "scalar";
+#endif
+}
+
+std::size_t simd_http_decoder::decode_head(const char *begin, const char *end) {
+    auto p = begin;
+
+    if (head_.empty()) {
+        // skip the empty lines before the start line, as http-parser does
+        while (p < end && (*p == CR || *p == LF))
+            ++p;
+        if (p == end)
+            return p - begin;
+
+        // fast path, the whole head is received in one read
+        auto i = find_head_end(p, 0, end - p);
+        if (i != npos) {
+            if (!parse_head(p, i + 1))
+                return fail("bad message head");
+            return p + i + 1 - begin;
+        }
+
+        if (end - p > MAX_HEAD_SIZE)
+            return fail("message head too large");
+
+        head_.assign(p, end);
+        return end - begin;
+    }
+
+    auto old_size = head_.size();
+    head_.append(p, end);
+
+    auto i = find_head_end(head_.data(), old_size, head_.size());
+    if (i == npos) {
+        if (head_.size() > MAX_HEAD_SIZE)
+            return fail("message head too large");
+        return end - begin;
+    }
+
+    head_.resize(i + 1);
+    bool ok = parse_head(head_.data(), head_.size());
+    head_.clear();
+
+    if (!ok)
+        return fail("bad message head");
+    return i + 1 - old_size;
+}
+
+std::size_t simd_http_decoder::decode_body(const char *begin, const char *end) {
+    auto p = begin;
+    bool chunked = chunked_;
+
+    while (p < end && state_ != DONE && state_ != INVALID) {
+        switch (state_) {
+        case BODY_IDENTITY: {
+            auto n = std::min<std::size_t>(remaining_, end - p);
+            message_->append_body(p, n);
+            p += n;
+            remaining_ -= n;
+            if (remaining_ == 0)
+                complete();
+            break;
+        }
+        case BODY_EOF: {
+            message_->append_body(p, end - p);
+            p = end;
+            break;
+        }
+        case CHUNK_SIZE: {
+            char c = *p++;
+            int digit = hex_value(c);
+            if (digit >= 0) {
+                if (remaining_ > (std::numeric_limits<std::size_t>::max() >> 4))
+                    return fail("chunk size overflow");
+                remaining_ = remaining_ * 16 + digit;
+                chunk_size_seen_ = true;
+            } else if (c == ';' || is_space(c)) {
+                state_ = CHUNK_EXTENSION;
+            } else if (c == LF) {
+                if (!chunk_size_seen_)
+                    return fail("bad chunk size");
+                chunk_size_seen_ = false;
+                if (remaining_ == 0) {
+                    state_ = CHUNK_TRAILER;
+                    trailer_line_empty_ = true;
+                } else {
+                    state_ = CHUNK_DATA;
+                }
+            } else if (c != CR) {
+                return fail("bad chunk size");
+            }
+            break;
+        }
+        case CHUNK_EXTENSION: {
+            // the extensions are ignored, the LF is handled as in CHUNK_SIZE
+            p = find_any(p, end, LF, LF);
+            if (p != end)
+                state_ = CHUNK_SIZE;
+            break;
+        }
+        case CHUNK_DATA: {
+            auto n = std::min<std::size_t>(remaining_, end - p);
+            p += n;
+            remaining_ -= n;
+            if (remaining_ == 0)
+                state_ = CHUNK_DATA_END;
+            break;
+        }
+        case CHUNK_DATA_END: {
+            char c = *p++;
+            if (c == LF)
+                state_ = CHUNK_SIZE;
+            else if (c != CR)
+                return fail("bad chunk end");
+            break;
+        }
+        case CHUNK_TRAILER: {
+            // the body ends at the empty line after the trailers
+            char c = *p++;
+            if (c == LF) {
+                if (trailer_line_empty_)
+                    complete();
+                trailer_line_empty_ = true;
+            } else if (c != CR) {
+                trailer_line_empty_ = false;
+            }
+            break;
+        }
+        default:
+            assert(0);
+        }
+    }
+
+    // the chunked body is forwarded as it is, with the chunk framing and the
+    // trailers, the states above only find where it ends
+    if (chunked && state_ != INVALID)
+        message_->append_body(begin, p - begin);
+
+    return p - begin;
+}
+
+bool simd_http_decoder::parse_head(const char *head, std::size_t size) {
+    auto end = head + size;
+    auto eol = find_any(head, end, LF, LF);
+    assert(eol != end);
+
+    auto line_end = eol > head && eol[-1] == CR ? eol - 1 : eol;
+    bool ok = type_ == HTTP_REQUEST
+            ? parse_request_line(head, line_end)
+            : parse_status_line(head, line_end);
+    if (!ok || !parse_headers(eol + 1, end))
+        return false;
+
+    message_->set_major_version(major_version_);
+    message_->set_minor_version(minor_version_);
+
+    headers_completed_ = true;
+    message_->headers_completed(true);
+
+    return prepare_body();
+}
+
+bool simd_http_decoder::parse_request_line(const char *begin, const char *end) {
+    auto method_end = find_any(begin, end, ' ', ' ');
+    if (method_end == begin || method_end == end)
+        return false;
+
+    for (auto p = begin; p < method_end; ++p) {
+        if (!((*p >= 'A' && *p <= 'Z') || *p == '-'))
+            return false;
+    }
+
+    auto uri = method_end + 1;
+    auto uri_end = find_any(uri, end, ' ', ' ');
+    if (uri_end == uri || uri_end == end)
+        return false;
+
+    if (!parse_version(uri_end + 1, end))
+        return false;
+
+    auto request = message::message_cast<message::http::http_request>(message_);
+
+    std::string method(begin, method_end);
+    if (method == "CONNECT")
+        request->set_uri(std::string(uri, uri_end));
+    else
+        request->set_uri(http_decoder::origin_form(uri, uri_end - uri));
+    request->set_method(method);
+
+    return true;
+}
+
+bool simd_http_decoder::parse_status_line(const char *begin, const char *end) {
+    auto version_end = find_any(begin, end, ' ', ' ');
+    if (version_end == end || !parse_version(begin, version_end))
+        return false;
+
+    auto p = version_end + 1;
+    if (end - p < 3)
+        return false;
+
+    status_ = 0;
+    for (auto i = 0; i < 3; ++i, ++p) {
+        if (*p < '0' || *p > '9')
+            return false;
+        status_ = status_ * 10 + (*p - '0');
+    }
+
+    if (p < end && *p++ != ' ')
+        return false;
+
+    auto response = message::message_cast<message::http::http_response>(message_);
+
+    response->set_status(status_);
+    response->set_message(std::string(p, end));
+
+    return true;
+}
+
+bool simd_http_decoder::parse_version(const char *begin, const char *end) {
+    if (end - begin < 8 || std::memcmp(begin, "HTTP/", 5) != 0)
+        return false;
+
+    auto parse_number = [end] (const char *& p, int& number) {
+        auto start = p;
+        number = 0;
+        while (p < end && *p >= '0' && *p <= '9' && p - start < 3)
+            number = number * 10 + (*p++ - '0');
+        return p > start;
+    };
+
+    auto p = begin + 5;
+    if (!parse_number(p, major_version_) || p == end || *p++ != '.')
+        return false;
+    if (!parse_number(p, minor_version_) || p != end)
+        return false;
+
+    return true;
+}
+
+bool simd_http_decoder::parse_headers(const char *begin, const char *end) {
+    auto& headers = message_->get_headers();
+    auto base = headers.raw_size();
+    headers.append_raw(begin, end - begin);
+
+    // the offsets of the header being parsed, it is added when the next one
+    // begins, as the value may be continued in the following lines
+    bool pending = false;
+    std::size_t name_offset = 0, name_size = 0, value_offset = 0, value_end = 0;
+
+    auto p = begin;
+    while (p < end) {
+        auto eol = find_any(p, end, LF, LF);
+        auto line_end = eol > p && eol[-1] == CR ? eol - 1 : eol;
+        if (line_end == p)
+            break;
+
+        if (is_space(*p)) {
+            // obsolete line folding, the value is continued
+            if (!pending)
+                return false;
+            auto e = line_end;
+            while (e > p && is_space(e[-1])) --e;
+            if (e > p)
+                value_end = base + (e - begin);
+        } else {
+            if (pending)
+                headers.add_raw(name_offset, name_size, value_offset, value_end - value_offset);
+
+            auto colon = find_any(p, line_end, ':', ':');
+            if (colon == p || colon == line_end)
+                return false;
+
+            // no whitespace is allowed in the name
+            if (find_any(p, colon, ' ', '\t') != colon)
+                return false;
+
+            auto v = colon + 1;
+            auto e = line_end;
+            while (v < e && is_space(*v)) ++v;
+            while (e > v && is_space(e[-1])) --e;
+
+            name_offset = base + (p - begin);
+            name_size = colon - p;
+            value_offset = base + (v - begin);
+            value_end = base + (e - begin);
+            pending = true;
+        }
+
+        p = eol + 1;
+    }
+
+    if (pending)
+        headers.add_raw(name_offset, name_size, value_offset, value_end - value_offset);
+    headers.complete_raw();
+
+    const auto& h = headers;
+    for (std::size_t i = 0; i < h.size(); ++i) {
+        switch (h.id(i)) {
+        case message::http::HEADER_CONNECTION:
+        case message::http::HEADER_PROXY_CONNECTION:
+            for_each_token(h.value(i), [this] (boost::string_ref token) {
+                if (message::http::http_headers::iequals(token, "close"))
+                    connection_close_ = true;
+                else if (message::http::http_headers::iequals(token, "keep-alive"))
+                    connection_keep_alive_ = true;
+            });
+            break;
+        case message::http::HEADER_CONTENT_LENGTH: {
+            auto value = h.value(i);
+            if (value.empty())
+                return false;
+
+            std::size_t length = 0;
+            for (auto c : value) {
+                if (c < '0' || c > '9' ||
+                    length > (std::numeric_limits<std::size_t>::max() - 9) / 10)
+                    return false;
+                length = length * 10 + (c - '0');
+            }
+
+            if (content_length_set_ && length != remaining_)
+                return false;
+            content_length_set_ = true;
+            remaining_ = length;
+            break;
+        }
+        case message::http::HEADER_TRANSFER_ENCODING: {
+            // the body is chunked if chunked is the last coding
+            bool chunked = false;
+            for_each_token(h.value(i), [&chunked] (boost::string_ref token) {
+                chunked = message::http::http_headers::iequals(token, "chunked");
+            });
+            chunked_ = chunked;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool simd_http_decoder::prepare_body() {
+    if (chunked_) {
+        state_ = CHUNK_SIZE;
+        remaining_ = 0;
+        chunk_size_seen_ = false;
+        return true;
+    }
+
+    if (content_length_set_) {
+        if (remaining_ == 0) {
+            complete();
+        } else {
+            state_ = BODY_IDENTITY;
+            if (remaining_ <= get_body_reserve_limit())
+                message_->reserve_body(remaining_);
+        }
+        return true;
+    }
+
+    if (type_ == HTTP_REQUEST || status_ / 100 == 1 || status_ == 204 || status_ == 304) {
+        complete();
+        return true;
+    }
+
+    state_ = BODY_EOF;
+    return true;
+}
+
+void simd_http_decoder::complete() {
+    state_ = DONE;
+    message_completed_ = true;
+    message_->message_completed(true);
+}
+
+std::size_t simd_http_decoder::fail(const char *reason) {
+    XERROR << "decode error: " << reason;
+    state_ = INVALID;
+    return 0;
+}
+
+} // namespace http
+} // namespace codec
+} // namespace x
@@ -0,0 +1,32 @@
+#include "test.hpp"
+#include "x/memory/buffer_pool.hpp"
+
+using namespace x::memory;
+
+TEST(test_buffer_pool, size_class) {
+    EXPECT_TRUE(buffer_pool::size_class(1) == 0);
+    EXPECT_TRUE(buffer_pool::size_class(1024) == 0);
+    EXPECT_TRUE(buffer_pool::size_class(1025) == 1);
+    EXPECT_TRUE(buffer_pool::size_class(8192) == 3);
+    EXPECT_TRUE(buffer_pool::size_class(buffer_pool::MAX_BLOCK_SIZE) == buffer_pool::CLASS_COUNT - 1);
+    EXPECT_TRUE(buffer_pool::size_class(buffer_pool::MAX_BLOCK_SIZE + 1) == buffer_pool::CLASS_COUNT);
+}
+
+TEST(test_buffer_pool, reuse) {
+    buffer_pool pool;
+
+    std::size_t capacity = 0;
+    char *b1 = pool.acquire(5000, capacity);
+    EXPECT_TRUE(capacity == 8192);
+
+    pool.release(b1, capacity);
+    EXPECT_TRUE(pool.retained() == 8192);
+
+    char *b2 = pool.acquire(8000, capacity);
+    EXPECT_TRUE(b2 == b1);
+    EXPECT_TRUE(pool.retained() == 0);
+
+    pool.set_max_retained(4096);
+    pool.release(b2, capacity);
+    EXPECT_TRUE(pool.retained() == 0);
+}
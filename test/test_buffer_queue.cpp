@@ -0,0 +1,34 @@
+#include "test.hpp"
+#include "x/memory/buffer_queue.hpp"
+
+using namespace x::memory;
+
+TEST(test_buffer_queue, consume) {
+    buffer_queue queue;
+    EXPECT_TRUE(queue.empty());
+
+    buffer_ptr b1(new byte_buffer);
+    buffer_ptr b2(new byte_buffer);
+    *b1 << "abcd";
+    *b2 << "ef";
+
+    queue.push_back(b1);
+    queue.push_back(b2);
+    EXPECT_TRUE(queue.bytes() == 6);
+    EXPECT_TRUE(b1->use_count() == 2);
+
+    EXPECT_FALSE(queue.consume(3));
+    EXPECT_TRUE(queue.bytes() == 3);
+    EXPECT_TRUE(queue.front_size() == 1);
+    EXPECT_TRUE(*queue.front_data() == 'd');
+
+    EXPECT_TRUE(queue.consume(1));
+    EXPECT_TRUE(queue.pop_front() == b1);
+    EXPECT_TRUE(b1->use_count() == 1);
+    EXPECT_TRUE(queue.bytes() == 2);
+
+    queue.consume(1);
+    queue.pop_front();
+    EXPECT_TRUE(queue.empty());
+    EXPECT_TRUE(queue.bytes() == 0);
+}
@@ -49,3 +49,35 @@ TEST(test_byte_buffer, common) {
 
     EXPECT_TRUE(aux == aux2);
 }
+
+TEST(test_byte_buffer, buffer_cache) {
+    buffer_cache cache;
+
+    auto b1 = cache.acquire();
+    *b1 << "abc";
+    auto p1 = b1.get();
+
+    auto b2 = b1;
+    cache.recycle(std::move(b1));
+    auto b3 = cache.acquire();
+    EXPECT_TRUE(b3.get() != p1);
+
+    cache.recycle(std::move(b2));
+    auto b4 = cache.acquire();
+    EXPECT_TRUE(b4.get() == p1);
+    EXPECT_TRUE(b4->empty());
+}
+
+TEST(test_byte_buffer, reserve) {
+    byte_buffer bb;
+    bb << "abc";
+
+    bb.reserve(10000);
+    EXPECT_TRUE(bb.capacity() >= 10000);
+    EXPECT_TRUE(bb.size() == 3);
+    EXPECT_TRUE(std::string(bb.data(), bb.size()) == "abc");
+
+    auto capacity = bb.capacity();
+    bb.reserve(100);
+    EXPECT_TRUE(bb.capacity() == capacity);
+}
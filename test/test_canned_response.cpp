@@ -0,0 +1,45 @@
+#include "test.hpp"
+#include "x/codec/http/canned_response.hpp"
+#include "x/codec/http/simd_http_decoder.hpp"
+#include "x/message/http/http_response.hpp"
+
+using namespace x::codec::http;
+using namespace x::message::http;
+
+TEST(test_canned_response, connection_established) {
+    auto data = canned_response(CONNECTION_ESTABLISHED);
+
+    // a 2xx reply to CONNECT has no body, and must not send Content-Length,
+    // so it ends right after the head (RFC 7230 section 3.3.2)
+    simd_http_decoder decoder(HTTP_RESPONSE);
+    http_response response;
+    EXPECT_TRUE(decoder.decode(data.data(), data.size(), response) == data.size());
+    EXPECT_TRUE(response.get_status() == 200);
+    EXPECT_TRUE(data.ends_with("\r\n\r\n"));
+
+    const http_message& msg = response;
+    EXPECT_FALSE(msg.get_headers().contains("Content-Length"));
+    EXPECT_TRUE(msg.get_headers().contains("Connection"));
+}
+
+TEST(test_canned_response, decodable) {
+    const unsigned statuses[CANNED_RESPONSE_COUNT] = { 200, 400, 502, 503, 504 };
+
+    // the reply of CONNECT is checked on its own above
+    for (int i = CONNECTION_ESTABLISHED + 1; i < CANNED_RESPONSE_COUNT; ++i) {
+        auto type = static_cast<canned_response_type>(i);
+        auto data = canned_response(type);
+
+        // the whole response is decoded, so Content-Length matches the body
+        simd_http_decoder decoder(HTTP_RESPONSE);
+        http_response response;
+        EXPECT_TRUE(decoder.decode(data.data(), data.size(), response) == data.size());
+        EXPECT_TRUE(response.completed());
+        EXPECT_TRUE(response.get_status() == statuses[i]);
+        EXPECT_FALSE(decoder.keep_alive());
+
+        const http_message& msg = response;
+        bool retry = type == SERVICE_UNAVAILABLE || type == GATEWAY_TIMEOUT;
+        EXPECT_TRUE(msg.get_headers().contains("Retry-After") == retry);
+    }
+}
@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <openssl/rsa.h>
+#include "test.hpp"
+#include "x/ssl/certificate_manager.hpp"
+#include "x/ssl/certificate_store.hpp"
+
+using namespace x::ssl;
+
+namespace {
+
+const char *STORE_FILE = "test_certificates.db";
+
+certificate make_certificate(const std::string& common_name) {
+    EVP_PKEY *key = EVP_PKEY_new();
+    EVP_PKEY_assign_RSA(key, RSA_generate_key(1024, RSA_F4, nullptr, nullptr));
+
+    X509 *x509 = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+    X509_gmtime_adj(X509_get_notBefore(x509), 0);
+    X509_gmtime_adj(X509_get_notAfter(x509), 60 * 60 * 24);
+    X509_set_pubkey(x509, key);
+    X509_NAME *name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               reinterpret_cast<const unsigned char *>(common_name.c_str()), -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+    X509_sign(x509, key, EVP_sha1());
+
+    certificate cert;
+    cert.set_cert(x509);
+    cert.set_key(key);
+    return cert;
+}
+
+bool same_certificate(const certificate& c1, const certificate& c2) {
+    return c1.cert() && c2.cert() && X509_cmp(c1.cert(), c2.cert()) == 0;
+}
+
+} // anonymous namespace
+
+TEST(test_certificate_store, save_and_find) {
+    std::remove(STORE_FILE);
+
+    auto c1 = make_certificate("a.example.com");
+    auto c2 = make_certificate("*.example.org");
+
+    {
+        certificate_store store(STORE_FILE);
+        EXPECT_TRUE(store.open());
+        EXPECT_TRUE(store.size() == 0);
+        EXPECT_TRUE(store.save("a.example.com", c1));
+        EXPECT_TRUE(store.save("*.example.org", c2));
+
+        certificate found;
+        EXPECT_TRUE(store.find("a.example.com", found));
+        EXPECT_TRUE(same_certificate(found, c1));
+        EXPECT_TRUE(found.key() != nullptr);
+        EXPECT_FALSE(store.find("b.example.com", found));
+    }
+
+    certificate_store store(STORE_FILE);
+    EXPECT_TRUE(store.open());
+    EXPECT_TRUE(store.size() == 2);
+
+    certificate found;
+    EXPECT_TRUE(store.find("*.example.org", found));
+    EXPECT_TRUE(same_certificate(found, c2));
+
+    std::remove(STORE_FILE);
+}
+
+TEST(test_certificate_store, torn_record) {
+    std::remove(STORE_FILE);
+
+    auto c1 = make_certificate("a.example.com");
+
+    {
+        certificate_store store(STORE_FILE);
+        EXPECT_TRUE(store.open());
+        EXPECT_TRUE(store.save("a.example.com", c1));
+    }
+
+    // simulate a crash in the middle of appending a record
+    FILE *fp = std::fopen(STORE_FILE, "ab");
+    std::fwrite("XCRT\x10\x00", 6, 1, fp);
+    std::fclose(fp);
+
+    {
+        certificate_store store(STORE_FILE);
+        EXPECT_TRUE(store.open());
+        EXPECT_TRUE(store.size() == 1);
+        EXPECT_TRUE(store.save("a.example.com", c1));
+    }
+
+    certificate_store store(STORE_FILE);
+    EXPECT_TRUE(store.open());
+    EXPECT_TRUE(store.size() == 1);
+
+    certificate found;
+    EXPECT_TRUE(store.find("a.example.com", found));
+    EXPECT_TRUE(same_certificate(found, c1));
+
+    std::remove(STORE_FILE);
+}
+
+TEST(test_certificate_store, torn_tail_cut_off) {
+    std::remove(STORE_FILE);
+
+    auto c1 = make_certificate("a.example.com");
+    auto c2 = make_certificate("b.example.com");
+
+    {
+        certificate_store store(STORE_FILE);
+
+        // nothing is appended before the valid records are known
+        EXPECT_FALSE(store.save("a.example.com", c1));
+
+        EXPECT_TRUE(store.open());
+        EXPECT_TRUE(store.save("a.example.com", c1));
+
+        // simulate an append failed after the store is opened, the torn
+        // bytes are cut off before the next record
+        FILE *fp = std::fopen(STORE_FILE, "ab");
+        std::fwrite("XCRT\x10\x00", 6, 1, fp);
+        std::fclose(fp);
+
+        EXPECT_TRUE(store.save("b.example.com", c2));
+    }
+
+    certificate_store store(STORE_FILE);
+    EXPECT_TRUE(store.open());
+    EXPECT_TRUE(store.size() == 2);
+
+    certificate found;
+    EXPECT_TRUE(store.find("b.example.com", found));
+    EXPECT_TRUE(same_certificate(found, c2));
+
+    std::remove(STORE_FILE);
+}
@@ -0,0 +1,148 @@
+#include "test.hpp"
+#include "x/codec/http/http_decoder.hpp"
+#include "x/message/http/http_request.hpp"
+#include "x/message/http/http_response.hpp"
+
+using namespace x::codec::http;
+using namespace x::message::http;
+
+namespace {
+
+std::string body_of(const http_message& msg) {
+    return std::string(msg.get_body().data(), msg.get_body().size());
+}
+
+} // anonymous namespace
+
+TEST(test_http_decoder, pipelined_requests) {
+    const std::string first = "GET http://example.com/a HTTP/1.1\r\nHost: example.com\r\n\r\n";
+    const std::string second = "POST /b HTTP/1.1\r\nHost: example.com\r\nContent-Length: 2\r\n\r\nok";
+    const std::string data = first + second;
+
+    http_decoder decoder(HTTP_REQUEST);
+    http_request request;
+
+    // the decoder stops at the end of the first request
+    EXPECT_TRUE(decoder.decode(data.data(), data.size(), request) == first.size());
+    EXPECT_TRUE(request.completed());
+    EXPECT_TRUE(request.get_method() == "GET");
+    EXPECT_TRUE(request.get_uri() == "/a");
+    EXPECT_TRUE(decoder.keep_alive());
+
+    decoder.reset();
+    request.reset();
+
+    auto rest = data.data() + first.size();
+    EXPECT_TRUE(decoder.decode(rest, second.size(), request) == second.size());
+    EXPECT_TRUE(request.completed());
+    EXPECT_TRUE(request.get_method() == "POST");
+    EXPECT_TRUE(request.get_uri() == "/b");
+    EXPECT_TRUE(body_of(request) == "ok");
+}
+
+TEST(test_http_decoder, split_headers) {
+    const std::string data = "GET /a HTTP/1.1\r\n"
+                             "Host: example.com\r\n"
+                             "X-Long: some value\r\n"
+                             "\r\n";
+
+    // the headers are split in a name, in a value and before the last LF
+    const std::size_t splits[] = { 20, 47, data.size() - 1 };
+
+    http_decoder decoder(HTTP_REQUEST);
+    http_request request;
+
+    std::size_t offset = 0;
+    for (auto split : splits) {
+        EXPECT_TRUE(decoder.decode(data.data() + offset, split - offset, request) == split - offset);
+        EXPECT_FALSE(request.completed());
+        offset = split;
+    }
+
+    EXPECT_TRUE(decoder.decode(data.data() + offset, data.size() - offset, request) == data.size() - offset);
+    EXPECT_TRUE(request.completed());
+
+    std::string host, value;
+    EXPECT_TRUE(request.find_header(HEADER_HOST, host));
+    EXPECT_TRUE(host == "example.com");
+    EXPECT_TRUE(request.find_header("x-long", value));
+    EXPECT_TRUE(value == "some value");
+    EXPECT_TRUE(request.get_raw_headers() == "Host: example.com\r\n"
+                                             "X-Long: some value\r\n"
+                                             "\r\n");
+}
+
+TEST(test_http_decoder, chunked_response_byte_by_byte) {
+    const std::string data = "HTTP/1.1 200 OK\r\n"
+                             "Transfer-Encoding: chunked\r\n"
+                             "Connection: close\r\n"
+                             "\r\n"
+                             "5;ext=1\r\nhello\r\n"
+                             "0\r\n"
+                             "Trailer: x\r\n"
+                             "\r\n";
+
+    http_decoder decoder(HTTP_RESPONSE);
+    http_response response;
+
+    for (std::size_t i = 0; i < data.size(); ++i)
+        EXPECT_TRUE(decoder.decode(data.data() + i, 1, response) == 1);
+
+    // the chunked body is kept as it is received, the trailers included
+    EXPECT_TRUE(response.completed());
+    EXPECT_TRUE(response.get_status() == 200);
+    EXPECT_TRUE(body_of(response) == "5;ext=1\r\nhello\r\n"
+                                     "0\r\n"
+                                     "Trailer: x\r\n"
+                                     "\r\n");
+    EXPECT_FALSE(decoder.keep_alive());
+}
+
+TEST(test_http_decoder, chunked_response_and_next) {
+    const std::string first = "HTTP/1.1 200 OK\r\n"
+                              "Transfer-Encoding: chunked\r\n"
+                              "\r\n"
+                              "3\r\nabc\r\n"
+                              "0\r\n\r\n";
+    const std::string second = "HTTP/1.1 204 No Content\r\n\r\n";
+    const std::string data = first + second;
+
+    http_decoder decoder(HTTP_RESPONSE);
+    http_response response;
+
+    EXPECT_TRUE(decoder.decode(data.data(), data.size(), response) == first.size());
+    EXPECT_TRUE(response.completed());
+    EXPECT_TRUE(body_of(response) == "3\r\nabc\r\n0\r\n\r\n");
+
+    decoder.reset();
+    response.reset();
+
+    EXPECT_TRUE(decoder.decode(data.data() + first.size(), second.size(), response) == second.size());
+    EXPECT_TRUE(response.completed());
+    EXPECT_TRUE(response.get_status() == 204);
+}
+
+TEST(test_http_decoder, continue_and_final_response) {
+    const std::string interim = "HTTP/1.1 100 Continue\r\n\r\n";
+    const std::string final = "HTTP/1.1 200 OK\r\n"
+                              "Content-Length: 2\r\n"
+                              "\r\n"
+                              "ok";
+    const std::string data = interim + final;
+
+    http_decoder decoder(HTTP_RESPONSE);
+    http_response response;
+
+    // the interim response is completed at the head, the final one follows
+    EXPECT_TRUE(decoder.decode(data.data(), data.size(), response) == interim.size());
+    EXPECT_TRUE(response.completed());
+    EXPECT_TRUE(response.get_status() == 100);
+
+    decoder.reset();
+    response.reset();
+
+    EXPECT_TRUE(decoder.decode(data.data() + interim.size(), final.size(), response) == final.size());
+    EXPECT_TRUE(response.completed());
+    EXPECT_TRUE(response.get_status() == 200);
+    EXPECT_TRUE(body_of(response) == "ok");
+}
@@ -0,0 +1,75 @@
+#include "test.hpp"
+#include "x/codec/http/http_encoder.hpp"
+#include "x/memory/byte_buffer.hpp"
+#include "x/message/http/http_request.hpp"
+#include "x/message/http/http_response.hpp"
+#include "x/util/itoa.hpp"
+
+using namespace x::codec::http;
+using namespace x::memory;
+using namespace x::message::http;
+
+namespace {
+
+std::string string_of(const byte_buffer& buf) {
+    return std::string(buf.data(), buf.size());
+}
+
+} // anonymous namespace
+
+TEST(test_http_encoder, itoa) {
+    const std::uint64_t values[] = { 0, 9, 10, 99, 100, 200, 1234, 65536, 18446744073709551615ull };
+    for (auto value : values) {
+        char out[20];
+        auto size = x::util::itoa(value, out);
+        EXPECT_TRUE(size == x::util::digits10(value));
+        EXPECT_TRUE(std::string(out, size) == std::to_string(value));
+    }
+}
+
+TEST(test_http_encoder, request) {
+    http_request request;
+    request.set_method("GET");
+    request.set_uri("/index.html");
+    request.set_major_version(1);
+    request.set_minor_version(1);
+    request.add_header("Host", "example.com");
+    request.add_header("Accept", "*/*");
+    request.headers_completed(true);
+    request.message_completed(true);
+
+    http_encoder encoder(HTTP_REQUEST);
+    byte_buffer buf;
+    auto size = encoder.encode(request, buf);
+
+    const std::string expected = "GET /index.html HTTP/1.1\r\n"
+                                 "Host: example.com\r\n"
+                                 "Accept: */*\r\n"
+                                 "\r\n";
+    EXPECT_TRUE(size == expected.size());
+    EXPECT_TRUE(string_of(buf) == expected);
+}
+
+TEST(test_http_encoder, response) {
+    http_response response;
+    response.set_major_version(1);
+    response.set_minor_version(0);
+    response.set_status(404);
+    response.set_message("Not Found");
+    response.add_header("Content-Length", "4");
+    response.headers_completed(true);
+    response.append_body("gone");
+    response.message_completed(true);
+
+    http_encoder encoder(HTTP_RESPONSE);
+    byte_buffer buf;
+    buf << "x";
+    auto size = encoder.encode(response, buf);
+
+    const std::string expected = "HTTP/1.0 404 Not Found\r\n"
+                                 "Content-Length: 4\r\n"
+                                 "\r\n"
+                                 "gone";
+    EXPECT_TRUE(size == expected.size());
+    EXPECT_TRUE(string_of(buf) == "x" + expected);
+}
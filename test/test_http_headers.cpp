@@ -0,0 +1,58 @@
+#include "test.hpp"
+#include "x/message/http/http_headers.hpp"
+
+using namespace x::message::http;
+
+TEST(test_http_headers, order_and_duplicates) {
+    http_headers headers;
+    headers.add("Host", "example.com");
+    headers.add("Set-Cookie", "a=1");
+    headers.add("Accept", "*/*");
+    headers.add("Set-Cookie", "b=2");
+
+    EXPECT_TRUE(headers.size() == 4);
+    EXPECT_TRUE(headers.name(0) == "Host");
+    EXPECT_TRUE(headers.name(3) == "Set-Cookie");
+    EXPECT_TRUE(headers.value(3) == "b=2");
+
+    std::string cookies;
+    headers.for_each("set-cookie", [&cookies] (http_headers::string_ref value) {
+        cookies.append(value.data(), value.size()).append(1, ';');
+    });
+    EXPECT_TRUE(cookies == "a=1;b=2;");
+}
+
+TEST(test_http_headers, case_insensitive_find) {
+    http_headers headers;
+    headers.add("Content-Length", "10");
+
+    std::string value;
+    EXPECT_TRUE(headers.find("content-length", value));
+    EXPECT_TRUE(value == "10");
+    EXPECT_TRUE(headers.find("CONTENT-LENGTH", value));
+    EXPECT_FALSE(headers.find("Content-Type", value));
+    EXPECT_FALSE(headers.contains("Content-Lengt"));
+
+    headers.clear();
+    EXPECT_TRUE(headers.empty());
+    EXPECT_FALSE(headers.contains("Content-Length"));
+}
+
+TEST(test_http_headers, header_id) {
+    EXPECT_TRUE(header_hash("content-length") == http_headers::hash("Content-Length"));
+    EXPECT_TRUE(to_header_id("HOST", http_headers::hash("HOST")) == HEADER_HOST);
+    EXPECT_TRUE(to_header_id("X-Host", http_headers::hash("X-Host")) == HEADER_UNKNOWN);
+
+    http_headers headers;
+    headers.add("X-Forwarded-For", "1.2.3.4");
+    headers.add("host", "example.com");
+    headers.add("Host", "example.org");
+
+    EXPECT_TRUE(headers.id(0) == HEADER_UNKNOWN);
+    EXPECT_TRUE(headers.id(1) == HEADER_HOST);
+
+    std::string value;
+    EXPECT_TRUE(headers.find(HEADER_HOST, value));
+    EXPECT_TRUE(value == "example.com");
+    EXPECT_FALSE(headers.contains(HEADER_CONTENT_LENGTH));
+}
@@ -0,0 +1,111 @@
+#include "test.hpp"
+#include "x/net/request_pipeline.hpp"
+
+using namespace x::memory;
+using namespace x::message::http;
+using namespace x::net;
+
+namespace {
+
+buffer_ptr make_buffer(const char *data) {
+    buffer_ptr buf(new byte_buffer);
+    *buf << data;
+    return buf;
+}
+
+std::string string_of(const byte_buffer& buf) {
+    return std::string(buf.data(), buf.size());
+}
+
+} // anonymous namespace
+
+TEST(test_request_pipeline, fifo) {
+    request_pipeline pipeline;
+    EXPECT_TRUE(pipeline.empty());
+
+    pipeline.push(make_buffer("a"), true);
+    pipeline.push(make_buffer("b"), true);
+    pipeline.push(make_buffer("c"), false);
+    EXPECT_TRUE(pipeline.size() == 3);
+
+    // the responses are matched to the requests in the order they are written
+    EXPECT_TRUE(string_of(pipeline.front()) == "a");
+    pipeline.pop();
+    EXPECT_TRUE(string_of(pipeline.front()) == "b");
+    pipeline.pop();
+    EXPECT_TRUE(string_of(pipeline.front()) == "c");
+    pipeline.pop();
+    EXPECT_TRUE(pipeline.empty());
+}
+
+TEST(test_request_pipeline, deferred) {
+    request_pipeline pipeline;
+
+    http_request get;
+    get.set_method("GET");
+    http_request post;
+    post.set_method("POST");
+    http_request upgrade;
+    upgrade.set_method("GET");
+    upgrade.add_header("Upgrade", "websocket");
+
+    EXPECT_TRUE(request_pipeline::idempotent(get));
+    EXPECT_FALSE(request_pipeline::idempotent(post));
+    EXPECT_FALSE(request_pipeline::idempotent(upgrade));
+
+    // any request is written to an idle connection
+    EXPECT_TRUE(pipeline.accepts(post));
+    EXPECT_TRUE(pipeline.accepts(upgrade));
+
+    // only the idempotent ones are written behind another request
+    pipeline.push(make_buffer("GET"), true);
+    EXPECT_TRUE(pipeline.accepts(get));
+    EXPECT_FALSE(pipeline.accepts(post));
+    EXPECT_FALSE(pipeline.accepts(upgrade));
+
+    pipeline.pop();
+    EXPECT_TRUE(pipeline.accepts(post));
+}
+
+TEST(test_request_pipeline, pipelinable) {
+    request_pipeline pipeline;
+    EXPECT_FALSE(pipeline.pipelinable(true));
+
+    pipeline.push(make_buffer("GET"), true);
+    EXPECT_TRUE(pipeline.pipelinable(true));
+    EXPECT_FALSE(pipeline.pipelinable(false));
+
+    while (!pipeline.full())
+        pipeline.push(make_buffer("GET"), true);
+    EXPECT_TRUE(pipeline.size() == request_pipeline::MAX_IN_FLIGHT);
+    EXPECT_FALSE(pipeline.pipelinable(true));
+
+    pipeline.clear();
+    pipeline.push(make_buffer("POST"), false);
+    EXPECT_FALSE(pipeline.pipelinable(true));
+}
+
+TEST(test_request_pipeline, replay) {
+    request_pipeline pipeline;
+    EXPECT_FALSE(pipeline.replayable());
+
+    pipeline.push(make_buffer("first "), true);
+    pipeline.push(make_buffer("second"), true);
+    EXPECT_TRUE(pipeline.replayable());
+
+    // the requests are copied in one buffer, in the order they are written
+    auto buf = pipeline.replay();
+    EXPECT_TRUE(string_of(*buf) == "first second");
+    EXPECT_TRUE(pipeline.size() == 2);
+
+    // replayed once at most, unless the server makes progress
+    EXPECT_FALSE(pipeline.replayable());
+    pipeline.pop();
+    EXPECT_TRUE(pipeline.replayable());
+    EXPECT_TRUE(string_of(*pipeline.replay()) == "second");
+
+    pipeline.clear();
+    pipeline.push(make_buffer("GET"), true);
+    pipeline.push(make_buffer("POST"), false);
+    EXPECT_FALSE(pipeline.replayable());
+}
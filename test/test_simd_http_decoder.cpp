@@ -0,0 +1,164 @@
+#include "test.hpp"
+#include "x/codec/http/simd_http_decoder.hpp"
+#include "x/message/http/http_request.hpp"
+#include "x/message/http/http_response.hpp"
+
+using namespace x::codec::http;
+using namespace x::message::http;
+
+namespace {
+
+std::string body_of(const http_message& msg) {
+    return std::string(msg.get_body().data(), msg.get_body().size());
+}
+
+} // anonymous namespace
+
+TEST(test_simd_http_decoder, request) {
+    const std::string data = "\r\nGET http://example.com/a/b?c HTTP/1.1\r\n"
+                             "Host: example.com\r\n"
+                             "X-Folded: a\r\n b\r\n"
+                             "Content-Length: 4\r\n"
+                             "\r\n"
+                             "body";
+
+    simd_http_decoder decoder(HTTP_REQUEST);
+    http_request request;
+
+    EXPECT_TRUE(decoder.decode(data.data(), data.size(), request) == data.size());
+    EXPECT_TRUE(request.completed());
+    EXPECT_TRUE(request.get_method() == "GET");
+    EXPECT_TRUE(request.get_uri() == "/a/b?c");
+    EXPECT_TRUE(request.get_minor_version() == 1);
+    EXPECT_TRUE(body_of(request) == "body");
+    EXPECT_TRUE(decoder.keep_alive());
+
+    std::string host;
+    EXPECT_TRUE(request.find_header(HEADER_HOST, host));
+    EXPECT_TRUE(host == "example.com");
+    const http_message& msg = request;
+    EXPECT_TRUE(msg.get_headers().size() == 3);
+    EXPECT_TRUE(request.get_raw_headers() == "Host: example.com\r\n"
+                                             "X-Folded: a\r\n b\r\n"
+                                             "Content-Length: 4\r\n"
+                                             "\r\n");
+}
+
+TEST(test_simd_http_decoder, chunked_response_byte_by_byte) {
+    const std::string data = "HTTP/1.1 200 OK\r\n"
+                             "Transfer-Encoding: chunked\r\n"
+                             "Connection: close\r\n"
+                             "\r\n"
+                             "5;ext=1\r\nhello\r\n"
+                             "0\r\n"
+                             "Trailer: x\r\n"
+                             "\r\n";
+
+    simd_http_decoder decoder(HTTP_RESPONSE);
+    http_response response;
+
+    for (std::size_t i = 0; i < data.size(); ++i)
+        EXPECT_TRUE(decoder.decode(data.data() + i, 1, response) == 1);
+
+    EXPECT_TRUE(response.completed());
+    EXPECT_TRUE(response.get_status() == 200);
+    EXPECT_TRUE(response.get_message() == "OK");
+    EXPECT_TRUE(body_of(response) == "5;ext=1\r\nhello\r\n"
+                                     "0\r\n"
+                                     "Trailer: x\r\n"
+                                     "\r\n");
+    EXPECT_FALSE(decoder.keep_alive());
+}
+
+TEST(test_simd_http_decoder, skip_body) {
+    const std::string data = "HTTP/1.1 200 OK\r\n"
+                             "Content-Length: 10\r\n"
+                             "\r\n"
+                             "abc";
+
+    simd_http_decoder decoder(HTTP_RESPONSE);
+    http_response response;
+
+    EXPECT_TRUE(decoder.decode(data.data(), data.size(), response) == data.size());
+    EXPECT_TRUE(body_of(response) == "abc");
+    EXPECT_TRUE(decoder.body_remaining() == 7);
+
+    decoder.skip_body(4);
+    EXPECT_TRUE(decoder.body_remaining() == 3);
+    EXPECT_FALSE(response.completed());
+
+    decoder.skip_body(3);
+    EXPECT_TRUE(decoder.body_remaining() == 0);
+    EXPECT_TRUE(response.completed());
+    EXPECT_TRUE(decoder.keep_alive());
+}
+
+TEST(test_simd_http_decoder, pipelined_requests) {
+    const std::string first = "GET /a HTTP/1.1\r\nHost: example.com\r\n\r\n";
+    const std::string second = "POST /b HTTP/1.1\r\nHost: example.com\r\nContent-Length: 2\r\n\r\nok";
+    const std::string data = first + second;
+
+    simd_http_decoder decoder(HTTP_REQUEST);
+    http_request request;
+
+    EXPECT_TRUE(decoder.decode(data.data(), data.size(), request) == first.size());
+    EXPECT_TRUE(request.completed());
+    EXPECT_TRUE(request.get_uri() == "/a");
+
+    decoder.reset();
+    request.reset();
+
+    auto rest = data.data() + first.size();
+    EXPECT_TRUE(decoder.decode(rest, second.size(), request) == second.size());
+    EXPECT_TRUE(request.completed());
+    EXPECT_TRUE(request.get_method() == "POST");
+    EXPECT_TRUE(body_of(request) == "ok");
+}
+
+TEST(test_simd_http_decoder, switching_protocols) {
+    const std::string head = "HTTP/1.1 101 Switching Protocols\r\n"
+                             "Upgrade: websocket\r\n"
+                             "Connection: Upgrade\r\n\r\n";
+    const std::string data = head + "\x81\x02hi";
+
+    simd_http_decoder decoder(HTTP_RESPONSE);
+    http_response response;
+
+    // the bytes after the head belong to the new protocol
+    EXPECT_TRUE(decoder.decode(data.data(), data.size(), response) == head.size());
+    EXPECT_TRUE(response.completed());
+    EXPECT_TRUE(response.get_status() == 101);
+}
+
+TEST(test_simd_http_decoder, bad_message) {
+    const std::string data = "GET / HTTP/1.1\r\nBad Name: x\r\n\r\n";
+
+    simd_http_decoder decoder(HTTP_REQUEST);
+    http_request request;
+    EXPECT_TRUE(decoder.decode(data.data(), data.size(), request) == 0);
+}
+
+TEST(test_simd_http_decoder, continue_and_final_response) {
+    const std::string interim = "HTTP/1.1 100 Continue\r\n\r\n";
+    const std::string final = "HTTP/1.1 200 OK\r\n"
+                              "Content-Length: 2\r\n"
+                              "\r\n"
+                              "ok";
+    const std::string data = interim + final;
+
+    simd_http_decoder decoder(HTTP_RESPONSE);
+    http_response response;
+
+    // the interim response is completed at the head, the final one follows
+    EXPECT_TRUE(decoder.decode(data.data(), data.size(), response) == interim.size());
+    EXPECT_TRUE(response.completed());
+    EXPECT_TRUE(response.get_status() == 100);
+
+    decoder.reset();
+    response.reset();
+
+    EXPECT_TRUE(decoder.decode(data.data() + interim.size(), final.size(), response) == final.size());
+    EXPECT_TRUE(response.completed());
+    EXPECT_TRUE(response.get_status() == 200);
+    EXPECT_TRUE(body_of(response) == "ok");
+}